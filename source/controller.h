@@ -38,6 +38,8 @@
 
 #include "public.sdk/source/vst/vsteditcontroller.h"
 #include "public.sdk/source/vst/vstnoteexpressiontypes.h"
+#include "pluginterfaces/vst/ivstevents.h"
+#include <chrono>
 #include "pluginterfaces/vst/ivstmidicontrollers.h"
 #include "pluginterfaces/vst/ivstmidilearn.h"
 #include "pluginterfaces/vst/ivstnoteexpression.h"
@@ -151,6 +153,26 @@ public:
 //------------------------------------------------------------------------
 static constexpr auto MsgIDEvent = "Event";
 
+// Events played on the UI keyboard are sent to the processor as an array of ControllerEvents in the
+// binary attribute MsgIDEvent of one message. The processor places them in its blocks by their timestamp.
+struct ControllerEvent
+{
+	Event event;
+	int64 timestamp; // controllerEventTime() when the event happened
+};
+
+// Clock shared by the UI and the processor, in nanoseconds
+inline int64 controllerEventTime()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The UI collects its events and sends them at most this many milliseconds after the first one
+constexpr uint32 controllerEventFlushInterval = 10;
+// The processor plays the events this many nanoseconds after they happened, so that events which waited
+// for their message still land on their own sample. Twice the interval allows for a late timer.
+constexpr int64 controllerEventLatency = 2 * int64(controllerEventFlushInterval) * 1000000;
+
 //------------------------------------------------------------------------
 } // NoteExpressionSynth
 } // Vst
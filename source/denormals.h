@@ -0,0 +1,64 @@
+#pragma once
+
+
+/*
+ * Flush-to-zero for the audio thread
+ *
+ * The amplitudes of the modes and the state of the filters decay exponentially. Long tails end up in the
+ * denormal range where x86 processors get very slow. ScopedFlushDenormals makes the FPU treat denormal
+ * inputs and results as zero (FTZ/DAZ on SSE, FZ on AArch64) for as long as it lives and restores the
+ * previous mode afterwards, so the host's own settings are left alone.
+ */
+
+
+#ifndef __DENORMALS_H__
+#define __DENORMALS_H__
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define DENORMALS_SSE
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#include <cstdint>
+#define DENORMALS_AARCH64
+#endif
+
+
+namespace VSTMath {
+
+
+class ScopedFlushDenormals
+{
+public:
+	ScopedFlushDenormals() {
+#if defined(DENORMALS_SSE)
+		previous = _mm_getcsr();
+		_mm_setcsr(previous | flushToZero | denormalsAreZero);
+#elif defined(DENORMALS_AARCH64)
+		asm volatile("mrs %0, fpcr" : "=r"(previous));
+		asm volatile("msr fpcr, %0" : : "r"(previous | flushToZero));
+#endif
+	}
+	~ScopedFlushDenormals() {
+#if defined(DENORMALS_SSE)
+		_mm_setcsr(previous);
+#elif defined(DENORMALS_AARCH64)
+		asm volatile("msr fpcr, %0" : : "r"(previous));
+#endif
+	}
+
+	ScopedFlushDenormals(const ScopedFlushDenormals&) = delete;
+	ScopedFlushDenormals& operator=(const ScopedFlushDenormals&) = delete;
+
+private:
+#if defined(DENORMALS_SSE)
+	static constexpr unsigned int flushToZero = 0x8000;
+	static constexpr unsigned int denormalsAreZero = 0x0040;
+	unsigned int previous;
+#elif defined(DENORMALS_AARCH64)
+	static constexpr uint64_t flushToZero = uint64_t(1) << 24;
+	uint64_t previous;
+#endif
+};
+
+}
+#endif
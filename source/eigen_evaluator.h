@@ -9,9 +9,12 @@
 #include <functional>
 #include <cmath>
 #include <random>
+#include <queue>
 #include <chrono>
 #include <fstream>
+#include <limits>
 #include "legendre.h"
+#include "mode_kernel.h"
 
 namespace VSTMath {
 
@@ -122,10 +125,24 @@ template <class T, int d> Vector<T, d> operator*(T c, const Vector<T, d>& v) { r
 
 
 /*
- * (Abstract) eigenvalue problem base class that implements the main procedure with eigenfunctions and -values
- * and declares methods to evaluate the eigenfunctions, -values and weights for the i-th eigenvalue.
+ * Eigenvalue problem base class that implements the main procedure with eigenfunctions and -values.
+ *
+ * The class uses static polymorphism (CRTP) so that all calls in the per-sample loops can be inlined.
+ * Derived needs to implement the following methods for the i-th eigenvalue:
+ *
+ *   T eigenFunction(int i, const Vector<T, d> x) const;
+ *   T eigenValue_sqrt(int i) const;                       // squareroots of eigenvalues for better performance
+ *   complex<T> amplitude(int i) const;
+ *   void setAmplitude(int i, complex<T> value);
+ *
+ * The number of modes is set at runtime. setMaxModes() allocates storage for all per-mode arrays, after
+ * that setNumModes() can choose any count up to that capacity without allocating.
+ *
+ * Only active modes are evolved and evaluated. Modes are culled in chunks of modePadding once none of
+ * them exceeds the amplitude floor, and come back as soon as pinchDelta() or pinch() excites them.
+ * Modes that oscillate faster than the Nyquist frequency are never processed at all.
  */
-template <class T, int d, int N>
+template <class Derived, class T, int d>
 class EigenvalueProblem
 {
 public:
@@ -134,7 +151,7 @@ public:
     }
     // Evaluate for next time step at spatial position xOut.
     T next(const Vector<T, d> xOut) {
-	   evolve(deltaT);
+	   evolve();
 	   return evaluate(time, xOut);
     }
 
@@ -147,7 +164,7 @@ public:
     // Evaluate for next time step at [channels] spatial positions for Stereo or multichannel processing.
     template <int channels>
     array<T, channels> next(const array<Vector<T, d>, channels>& xOuts) {
-	   evolve(deltaT);
+	   evolve();
 	   array<T, channels> out;
 	   for (int i = 0; i < channels; i++)
 		  out[i] = evaluate(time, xOuts[i]);
@@ -163,15 +180,22 @@ public:
 
     // "Pinch" at the system with delta peak.
     void pinchDelta(const Vector<T, d> x, T amount) {
-	   for (int i = 0; i < N; i++) {
-		  setAmplitude(i, amplitude(i) + eigenFunction(i, x) * amount);
+	   prepareStepFactors();
+	   for (int i = 0; i < nyquistLimit; i++) {
+		  const T value = derived().eigenFunction(i, x) * amount;
+		  if (value == T{ 0 }) continue;
+		  derived().setAmplitude(i, derived().amplitude(i) + value);
+		  activateMode(i);
 	   }
     }
 
-    // "Pinch" at the system by adding to all amplitudes.
-    void pinch(const array<complex<T>, N>& values) {
-	   for (int i = 0; i < N; i++) {
-		  setAmplitude(i, amplitude(i) + values[i]);
+    // "Pinch" at the system by adding to all amplitudes. values needs to hold getNumModes() entries.
+    void pinch(const complex<T>* values) {
+	   prepareStepFactors();
+	   for (int i = 0; i < nyquistLimit; i++) {
+		  if (values[i] == complex<T>{ 0 }) continue;
+		  derived().setAmplitude(i, derived().amplitude(i) + values[i]);
+		  activateMode(i);
 	   }
     }
 
@@ -180,9 +204,14 @@ public:
 
     // Set all amplitudes to zero
     void silence() {
-	   for (int i = 0; i < N; i++) {
-		  setAmplitude(i, T{ 0 });
+	   for (int i = 0; i < numModes; i++) {
+		  derived().setAmplitude(i, T{ 0 });
 	   }
+	   std::fill(chunkActive.data(), chunkActive.data() + chunkActive.size(), false);
+	   numActiveChunks = 0;
+	   activeChunksDirty = false;
+	   energy = T{ 0 };
+	   energyValid = true;
     }
     // Call silence() and set time to 0
     void reset() {
@@ -197,12 +226,73 @@ public:
     // Get current time
     T getTime() const { return time; }
     // Set step time interval according to sampling rate
-    void setSampleRate(T sampleRate) { this->deltaT = T{ 1. } / sampleRate; }
+    void setSampleRate(T sampleRate) { this->deltaT = T{ 1. } / sampleRate; invalidateStepFactors(); }
 
 
-    void setVelocity_sq(complex<T> v_sq) { velocity_sq = v_sq; }
+    void setVelocity_sq(complex<T> v_sq) {
+	   if (v_sq == velocity_sq) return;
+	   velocity_sq = v_sq;
+	   invalidateStepFactors();
+    }
     complex<T> getVelocity_sq() { return velocity_sq; }
 
+    // Allocate storage for up to maxModes modes and reset all amplitudes. Allocates memory, so this must
+    // not be called from the audio thread.
+    void setMaxModes(int maxModes) {
+	   this->maxModes = std::max(maxModes, 0);
+	   numModes = std::min(numModes, this->maxModes);
+	   derived().allocateModes(paddedModeCount(this->maxModes));
+	   activateAllModes();
+	   derived().modeCountChanged();
+    }
+    int getMaxModes() const { return maxModes; }
+
+    // Set the number of modes in use, clamped to [0, getMaxModes()]. This doesn't allocate.
+    void setNumModes(int numModes) {
+	   numModes = std::clamp(numModes, 0, maxModes);
+	   if (numModes == this->numModes) return;
+	   for (int i = numModes; i < this->numModes; i++) {
+		  derived().setAmplitude(i, T{ 0 });
+	   }
+	   this->numModes = numModes;
+	   activateAllModes();
+	   derived().modeCountChanged();
+    }
+    int getNumModes() const { return numModes; }
+    // All modes from this index on are above the Nyquist frequency (or have no higher modes below it)
+    int getNumModesBelowNyquist() { prepareStepFactors(); return nyquistLimit; }
+
+    // Modes are dropped from processing once |amplitude| stays below this floor. With the default of 0
+    // only modes that are exactly silent are skipped.
+    void setAmplitudeFloor(T floor) { amplitudeFloor_sq = floor * floor; }
+    T getAmplitudeFloor() const { return std::sqrt(amplitudeFloor_sq); }
+
+    // Total energy Σ|a_i|² of all modes. Block processing keeps it up to date when culling, otherwise it
+    // is summed up here. Modes that don't oscillate (like the constant mode of the sphere) never decay and
+    // only add a DC offset, they are left out.
+    T getEnergy() {
+	   if (!energyValid) {
+		  prepareStepFactors();
+		  energy = T{ 0 };
+		  forEachActiveMode([&](int i) { if (oscillates(i)) energy += std::norm(derived().amplitude(i)); });
+		  energyValid = true;
+	   }
+	   return energy;
+    }
+    // Number of samples until the energy has decayed from the given value below the amplitude floor
+    // squared, judged by the slowest decaying mode. Returns -1 if the modes don't decay at all.
+    long long getDecaySamples(T fromEnergy) {
+	   prepareStepFactors();
+	   if (fromEnergy <= amplitudeFloor_sq) return 0;
+	   if (slowestDecay_sq >= T{ 1 } || amplitudeFloor_sq <= T{ 0 }) return -1;
+	   return static_cast<long long>(std::ceil(std::log(amplitudeFloor_sq / fromEnergy) / std::log(slowestDecay_sq)));
+    }
+
+    // Rotation factors of all modes for one time step (see updateStepFactors()), for code that advances
+    // copies of the amplitudes itself. Everything after getNumModes() is zero.
+    const T* getStepFactorsRe() { prepareStepFactors(); return stepFactorsRe.data(); }
+    const T* getStepFactorsIm() { prepareStepFactors(); return stepFactorsIm.data(); }
+
 protected:
     // Evolve time and amplitudes
     //void evolve(T deltaTime) {
@@ -221,38 +311,44 @@ protected:
     array<double, QM_number_bins> QM_distribution{ 0 };
     std::default_random_engine generator;
 
-    array<complex<T>, N> QM_old_amplitude;
+    std::vector<complex<T>> QM_old_amplitude;
 
     void init_QM() {
 	   unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
 	   generator = std::default_random_engine(seed);
     }
-    void evolve(T deltaTime) {
+    void evolve() {
+	   const T deltaTime = deltaT;
 	   time += deltaTime;
 	   if (QM_mode == false) {
-		  for (int i = 0; i < N; i++) {
-			 setAmplitude(i, amplitude(i) * std::exp(complex<T>(0, 1) * /*ω=*/velocity_sq * eigenValue_sqrt(i) * deltaTime));
+		  prepareStepFactors();
+		  forEachActiveMode([&](int i) {
+			 derived().setAmplitude(i, derived().amplitude(i) * stepFactor(i));
+		  });
+		  energyValid = false;
+		  if (++stepsSinceCull >= cullInterval) {
+			 cullModes();
 		  }
 	   }
 	   else {
-		  for (int i = 0; i < N; i++) {
+		  for (int i = 0; i < numModes; i++) {
 			 // if QM mode on
-			 complex<T> omega = velocity_sq * eigenValue_sqrt(i);
+			 complex<T> omega = velocity_sq * derived().eigenValue_sqrt(i);
 			 // loop over all x
 			 for (int j = 0; j < QM_distribution.size(); ++j) {
 				T x_ = static_cast<T>(QM_x_min + j * (QM_x_max - QM_x_min) / QM_number_bins);
 				complex<T> derivative_sq = std::pow((x_ - QM_old_amplitude[i]) / deltaTime, T{ 2 });
 
 				// with hbar = 1:
-				auto a = omega * omega * amplitude(i) * amplitude(i);
+				auto a = omega * omega * derived().amplitude(i) * derived().amplitude(i);
 				QM_distribution[j] = std::abs(std::exp(-complex<T>(0, 1) * (derivative_sq - a)).real());
 			 }
 			 std::discrete_distribution<int> value(QM_distribution.begin(), QM_distribution.end());
 			 int number = value(generator);
 			 double x = QM_x_min + number * (QM_x_max - QM_x_min) / QM_number_bins;
-			 complex<T> new_amplitude = amplitude(i) * std::exp(complex<T>(0, 1) * omega * deltaTime) * (static_cast<T>(x) + QM_old_amplitude[i]);
-			 QM_old_amplitude[i] = amplitude(i);
-			 setAmplitude(i, new_amplitude);
+			 complex<T> new_amplitude = derived().amplitude(i) * std::exp(complex<T>(0, 1) * omega * deltaTime) * (static_cast<T>(x) + QM_old_amplitude[i]);
+			 QM_old_amplitude[i] = derived().amplitude(i);
+			 derived().setAmplitude(i, new_amplitude);
 		  }
 	   }
     }
@@ -261,23 +357,181 @@ protected:
 
     T evaluate(T t, const Vector<T, d> x) {
 	   complex<T> result{ 0 };
-	   for (int i = 0; i < N; i++) {
-		  result += amplitude(i) * eigenFunction(i, x);
-	   }
+	   forEachActiveMode([&](int i) {
+		  result += derived().amplitude(i) * derived().eigenFunction(i, x);
+	   });
 	   return result.real();
     }
 
-    virtual T eigenFunction(int i, const Vector<T, d> x) const = 0;
-    virtual T eigenValue_sqrt(int i) const = 0; // Using squareroots of eigenvalues for better performance
-    virtual complex<T> amplitude(int i) const = 0;
-    virtual void setAmplitude(int i, complex<T> value) = 0;
+    // Rebuild the per-mode rotation factors exp(i·v²·√λ·Δt) which advance each amplitude by one time step.
+    // Modes that would rotate by more than π per step are above Nyquist and alias. They get a factor of 0
+    // and everything from the last mode below Nyquist on is excluded from processing.
+    void updateStepFactors() {
+	   int limit = 0;
+	   slowestDecay_sq = T{ 0 };
+	   for (int i = 0; i < numModes; i++) {
+		  const T eigenValue_sqrt = derived().eigenValue_sqrt(i);
+		  if (std::abs(velocity_sq.real() * eigenValue_sqrt * deltaT) > pi<T>()) {
+			 stepFactorsRe[i] = stepFactorsIm[i] = T{ 0 };
+			 continue;
+		  }
+		  complex<T> factor = std::exp(complex<T>(0, 1) * /*ω=*/velocity_sq * eigenValue_sqrt * deltaT);
+		  stepFactorsRe[i] = factor.real();
+		  stepFactorsIm[i] = factor.imag();
+		  if (eigenValue_sqrt != T{ 0 }) slowestDecay_sq = std::max(slowestDecay_sq, std::norm(factor));
+		  limit = i + 1;
+	   }
+	   std::fill(stepFactorsRe.data() + numModes, stepFactorsRe.data() + stepFactorsRe.size(), T{ 0 });
+	   std::fill(stepFactorsIm.data() + numModes, stepFactorsIm.data() + stepFactorsIm.size(), T{ 0 });
+	   // silence what was left of the modes above the new limit
+	   for (int i = limit; i < numModes; i++) {
+		  derived().setAmplitude(i, T{ 0 });
+	   }
+	   if (limit != nyquistLimit) {
+		  nyquistLimit = limit;
+		  activeChunksDirty = true;
+	   }
+	   energyValid = false;
+	   stepFactorsDirty = false;
+    }
+    void invalidateStepFactors() { stepFactorsDirty = true; }
+    // Rebuild the rotation factors if necessary. Call before reading stepFactorsRe/Im directly.
+    void prepareStepFactors() {
+	   if (stepFactorsDirty) updateStepFactors();
+    }
+    complex<T> stepFactor(int i) const { return { stepFactorsRe[i], stepFactorsIm[i] }; }
+    bool oscillates(int i) const { return stepFactorsRe[i] != T{ 1 } || stepFactorsIm[i] != T{ 0 }; }
+    // Advance time by a number of steps without touching the amplitudes (used by block processing)
+    void advanceTime(int numSteps) { time += numSteps * deltaT; }
+
+    // Number of chunks of modePadding modes that contain modes below Nyquist
+    int numChunks() const { return paddedModeCount(nyquistLimit) / modePadding; }
+
+    void activateMode(int i) { activateChunk(i / modePadding); }
+    void activateChunk(int chunk) {
+	   energyValid = false;
+	   if (!chunkActive[chunk]) {
+		  chunkActive[chunk] = true;
+		  activeChunksDirty = true;
+	   }
+    }
+    void activateAllModes() {
+	   const int chunks = paddedModeCount(numModes) / modePadding;
+	   std::fill(chunkActive.data(), chunkActive.data() + chunks, true);
+	   std::fill(chunkActive.data() + chunks, chunkActive.data() + chunkActive.size(), false);
+	   activeChunksDirty = true;
+	   energyValid = false;
+    }
+    // Rebuild the sorted list of active chunks after modes have been (re-)activated.
+    void prepareActiveModes() {
+	   if (!activeChunksDirty) return;
+	   numActiveChunks = 0;
+	   for (int c = 0; c < numChunks(); ++c) {
+		  if (chunkActive[c]) activeChunks[numActiveChunks++] = c;
+	   }
+	   activeChunksDirty = false;
+    }
+    // Deactivate all chunks in which no amplitude exceeds the floor. Their amplitudes are set to zero so
+    // that skipping them is exact. The energy of the remaining modes is summed up on the way.
+    // Single modes in the remaining chunks are set to zero too once they drop below the floor (or out of
+    // the normal range of T), so their decay doesn't run into denormals.
+    void cullModes() {
+	   stepsSinceCull = 0;
+	   prepareActiveModes();
+	   int kept = 0;
+	   energy = T{ 0 };
+	   const T snap_sq = std::max(amplitudeFloor_sq, std::numeric_limits<T>::min());
+	   for (int k = 0; k < numActiveChunks; ++k) {
+		  const int c = activeChunks[k];
+		  const int begin = c * modePadding;
+		  const int end = std::min(begin + modePadding, nyquistLimit);
+		  bool audible = false;
+		  T chunkEnergy{ 0 };
+		  for (int i = begin; i < end; ++i) {
+			 const T norm = std::norm(derived().amplitude(i));
+			 if (norm == T{ 0 }) continue;
+			 if (norm < snap_sq) {
+				derived().setAmplitude(i, T{ 0 });
+				continue;
+			 }
+			 audible |= norm > amplitudeFloor_sq;
+			 if (oscillates(i)) chunkEnergy += norm;
+		  }
+		  if (audible) {
+			 energy += chunkEnergy;
+			 activeChunks[kept++] = c;
+			 continue;
+		  }
+		  for (int i = begin; i < end; ++i) {
+			 derived().setAmplitude(i, T{ 0 });
+		  }
+		  chunkActive[c] = false;
+	   }
+	   numActiveChunks = kept;
+	   energyValid = true;
+    }
+    template <class F>
+    void forEachActiveMode(F&& f) {
+	   prepareActiveModes();
+	   for (int k = 0; k < numActiveChunks; ++k) {
+		  const int begin = activeChunks[k] * modePadding;
+		  const int end = std::min(begin + modePadding, nyquistLimit);
+		  for (int i = begin; i < end; ++i) f(i);
+	   }
+    }
+
+    // Hooks for the implementations, which may hide them. allocateModes() is called with the padded
+    // capacity and should call the version of its base class. modeCountChanged() is the place to rebuild
+    // a table of eigenvalues. Afterwards, and whenever the eigenvalues change, eigenvaluesChanged() needs
+    // to be called (through derived()).
+    void allocateModes(int capacity) {
+	   stepFactorsRe.resize(capacity);
+	   stepFactorsIm.resize(capacity);
+	   QM_old_amplitude.assign(capacity, T{ 0 });
+	   chunkActive.resize(capacity / modePadding);
+	   activeChunks.resize(capacity / modePadding);
+	   numActiveChunks = 0;
+    }
+    void modeCountChanged() { derived().eigenvaluesChanged(); }
+    void eigenvaluesChanged() { invalidateStepFactors(); }
+
+    Derived& derived() { return static_cast<Derived&>(*this); }
+    const Derived& derived() const { return static_cast<const Derived&>(*this); }
 
     T deltaT{ 0 };   // this needs to be set to 1/(sampling rate)
 
+    // Cached rotation factors (see updateStepFactors()), split into real and imaginary parts. They are
+    // rebuilt lazily because the eigenvalues of derived classes are not available yet during construction.
+    // Everything after numModes stays zero.
+    AlignedBuffer<T> stepFactorsRe;
+    AlignedBuffer<T> stepFactorsIm;
+
+    // Indices of the active chunks in ascending order, valid after prepareActiveModes()
+    AlignedBuffer<int> activeChunks;
+    int numActiveChunks = 0;
+
+    // The per-sample path culls every cullInterval steps, process() implementations once per block.
+    static constexpr int cullInterval = 64;
+
 private:
     T time{ 0 };     // current Time
 
     complex<T> velocity_sq = 1;
+
+    bool stepFactorsDirty = true;
+
+    int maxModes = 0;
+    int numModes = 0;
+    int nyquistLimit = 0;
+
+    AlignedBuffer<bool> chunkActive;
+    bool activeChunksDirty = false;
+    T amplitudeFloor_sq{ 0 };
+    int stepsSinceCull = 0;
+    // Largest |step factor|², i.e. how much energy the slowest mode keeps per step
+    T slowestDecay_sq{ 0 };
+    T energy{ 0 };
+    bool energyValid = true;
 };
 
 /*
@@ -285,41 +539,46 @@ private:
  *
  * Eigenfunctions are evaluated in setListeningPositions() at every listening position and stored.
  * When asking for the next sample, the cached values are used to compute the current deflection.
+ * The positions are kept so that the cache can be rebuilt when the modes change and so that moving a
+ * position only needs to update what actually changed.
  */
 
-template <class T, int d, int N, int numChannels = 1>
-class FixedListenerEigenvalueProblem : public EigenvalueProblem<T, d, N>
+template <class Derived, class T, int d, int numChannels = 1>
+class FixedListenerEigenvalueProblem : public EigenvalueProblem<Derived, T, d>
 {
+    using Base = EigenvalueProblem<Derived, T, d>;
+    friend Base;
 public:
 
+    // Setting a position only updates the cache for what has changed (see updateEigenFunctions()).
     void setListeningPositions(const array<Vector<T, d>, numChannels>& listeningPositions) {
 	   for (int i = 0; i < numChannels; ++i) {
-		  for (int j = 0; j < N; ++j) {
-			 eigenFunctionEvaluations[i][j] = this->eigenFunction(j, listeningPositions[i]);
-		  }
+		  moveListeningPosition(i, listeningPositions[i]);
 	   }
     }
     void setFirstListeningPosition(const Vector<T, d>& listeningPosition) {
-	   for (int j = 0; j < N; ++j) {
-		  eigenFunctionEvaluations[0][j] = this->eigenFunction(j, listeningPosition[0]);
-	   }
+	   moveListeningPosition(0, listeningPosition);
     }
 
     void setStrikingPosition(const Vector<T, d> strikingPosition) {
-	   for (int j = 0; j < N; ++j) {
-		  eigenFunctionEvaluation_strike[j] = this->eigenFunction(j, strikingPosition);
-	   }
+	   const Vector<T, d> previous = this->strikingPosition;
+	   this->strikingPosition = strikingPosition;
+	   this->derived().updateEigenFunctions(previous, strikingPosition, eigenFunctionEvaluation_strike.data(), strikeSlot);
     }
 
     // "Pinch" at the system with delta peak.
     void pinchDelta(T amount) {
-	   for (int i = 0; i < N; i++) {
-		  this->setAmplitude(i, this->amplitude(i) + eigenFunctionEvaluation_strike[i] * amount);
+	   const int numModes = this->getNumModesBelowNyquist();
+	   for (int i = 0; i < numModes; i++) {
+		  const T value = eigenFunctionEvaluation_strike[i] * amount;
+		  if (value == T{ 0 }) continue;
+		  this->derived().setAmplitude(i, this->derived().amplitude(i) + value);
+		  this->activateMode(i);
 	   }
     }
 
     array<T, numChannels> next() {
-	   this->evolve(this->deltaT);
+	   this->evolve();
 	   return evaluate(this->getTime());
     }
 
@@ -330,53 +589,247 @@ public:
     }
 
     T nextFirstChannel() {
-	   this->evolve(this->deltaT);
+	   this->evolve();
 	   return evaluateFirstChannel(this->getTime());
     }
 
+    // Cached eigenfunctions at a listening position and at the striking position
+    const T* getListeningEvaluations(int channel) const { return eigenFunctionEvaluations[channel].data(); }
+    const T* getStrikingEvaluations() const { return eigenFunctionEvaluation_strike.data(); }
+
+    // Render a block of numSamples samples into out[0..numChannels). If in is not nullptr, each input
+    // sample is fed into the system at the striking position before the time step (like next(T)).
+    // This generic version goes through amplitude() and setAmplitude() for every step. Implementations
+    // with direct access to their amplitudes may hide it with something better.
+    void process(const T* in, T* const* out, int numSamples) {
+	   for (int s = 0; s < numSamples; ++s) {
+		  auto result = in ? next(in[s]) : next();
+		  for (int i = 0; i < numChannels; ++i) out[i][s] = result[i];
+	   }
+    }
+
 protected:
 
     array<T, numChannels> evaluate(T t) {
 	   array<T, numChannels> results{ 0 };
-	   for (int i = 0; i < numChannels; ++i) {
-		  for (int j = 0; j < N; ++j) {
-			 results[i] += (this->amplitude(j) * eigenFunctionEvaluations[i][j]).real();
+	   this->forEachActiveMode([&](int j) {
+		  const T a = this->derived().amplitude(j).real();
+		  for (int i = 0; i < numChannels; ++i) {
+			 results[i] += a * eigenFunctionEvaluations[i][j];
 		  }
-	   }
+	   });
 	   return results;
     }
     T evaluateFirstChannel(T t) {
 	   T result{ 0 };
-	   for (int j = 0; j < N; ++j) {
-		  result += (this->amplitude(j) * eigenFunctionEvaluations[0][j]).real();
-	   }
+	   this->forEachActiveMode([&](int j) {
+		  result += this->derived().amplitude(j).real() * eigenFunctionEvaluations[0][j];
+	   });
 	   return result;
     }
 
-private:
-    // Eigenfunctions evaluated at the listening positions last set through setListeningPositions()
-    array<array<complex<T>, N>, numChannels> eigenFunctionEvaluations;
-    array<complex<T>, N> eigenFunctionEvaluation_strike;
+    // Activate all modes that an input at the striking position excites
+    void activateStruckModes() {
+	   for (int c = 0; c < this->numChunks(); ++c) {
+		  const T* strike = eigenFunctionEvaluation_strike.data() + c * modePadding;
+		  if (std::any_of(strike, strike + modePadding, [](T x) { return x != T{ 0 }; })) this->activateChunk(c);
+	   }
+    }
+
+    // Each cached position has a slot: the listening positions use 0..numChannels-1, the striking
+    // position uses strikeSlot. Implementations can keep per-slot data for incremental updates.
+    static constexpr int strikeSlot = numChannels;
+    static constexpr int numSlots = numChannels + 1;
+
+    // Evaluate all eigenfunctions at x and write them to out. Implementations may hide this with something
+    // faster than calling eigenFunction() for every mode.
+    void evaluateEigenFunctions(const Vector<T, d>& x, T* out, [[maybe_unused]] int slot) {
+	   for (int j = 0; j < this->getNumModes(); ++j) {
+		  out[j] = this->derived().eigenFunction(j, x);
+	   }
+    }
+    // Update the evaluations in out after the position of a slot moved from previous to x. Implementations
+    // may hide this with something that only recomputes what depends on the coordinates that changed.
+    void updateEigenFunctions(const Vector<T, d>& previous, const Vector<T, d>& x, T* out, int slot) {
+	   if (x != previous) this->derived().evaluateEigenFunctions(x, out, slot);
+    }
+
+    void moveListeningPosition(int channel, const Vector<T, d>& position) {
+	   const Vector<T, d> previous = listeningPositions[channel];
+	   listeningPositions[channel] = position;
+	   this->derived().updateEigenFunctions(previous, position, eigenFunctionEvaluations[channel].data(), channel);
+    }
+
+    void updateListeningEvaluations(int channel) {
+	   this->derived().evaluateEigenFunctions(listeningPositions[channel], eigenFunctionEvaluations[channel].data(), channel);
+	   std::fill(eigenFunctionEvaluations[channel].data() + this->getNumModes(), eigenFunctionEvaluations[channel].data() + eigenFunctionEvaluations[channel].size(), T{ 0 });
+    }
+    void updateStrikingEvaluations() {
+	   this->derived().evaluateEigenFunctions(strikingPosition, eigenFunctionEvaluation_strike.data(), strikeSlot);
+	   std::fill(eigenFunctionEvaluation_strike.data() + this->getNumModes(), eigenFunctionEvaluation_strike.data() + eigenFunctionEvaluation_strike.size(), T{ 0 });
+    }
 
+    void allocateModes(int capacity) {
+	   Base::allocateModes(capacity);
+	   for (auto& evaluations : eigenFunctionEvaluations) evaluations.resize(capacity);
+	   eigenFunctionEvaluation_strike.resize(capacity);
+    }
+    void eigenvaluesChanged() {
+	   Base::eigenvaluesChanged();
+	   for (int i = 0; i < numChannels; ++i) {
+		  updateListeningEvaluations(i);
+	   }
+	   updateStrikingEvaluations();
+    }
+
+    // Eigenfunctions evaluated at the listening positions last set through setListeningPositions().
+    // The eigenfunctions are real, so are the cached values. Everything after getNumModes() stays zero.
+    array<AlignedBuffer<T>, numChannels> eigenFunctionEvaluations;
+    AlignedBuffer<T> eigenFunctionEvaluation_strike;
+
+    array<Vector<T, d>, numChannels> listeningPositions{};
+    Vector<T, d> strikingPosition{};
 };
 
 
 /*
- * As all implementation probably keep a list of complex amplitudes, this (abstract) class implements
+ * As all implementation probably keep a list of complex amplitudes, this class implements
  * this feature for actual implementations to derive from.
  */
-template <class T, int d, int N, int numChannels>
-class EigenvalueProblemAmplitudeBase : public FixedListenerEigenvalueProblem<T, d, N, numChannels> {
+template <class Derived, class T, int d, int numChannels>
+class EigenvalueProblemAmplitudeBase : public FixedListenerEigenvalueProblem<Derived, T, d, numChannels> {
+    using Base = FixedListenerEigenvalueProblem<Derived, T, d, numChannels>;
+    friend EigenvalueProblem<Derived, T, d>;
 public:
-    virtual complex<T> amplitude(int i) const override {
-	   return amplitudes[i];
+    complex<T> amplitude(int i) const {
+	   return { amplitudesRe[i], amplitudesIm[i] };
     }
-    virtual void setAmplitude(int i, complex<T> value) override {
-	   amplitudes[i] = value;
+    void setAmplitude(int i, complex<T> value) {
+	   amplitudesRe[i] = value.real();
+	   amplitudesIm[i] = value.imag();
     };
 
+    // Block processing with the SIMD kernel from mode_kernel.h which rotates all active amplitudes and
+    // accumulates all channels in one pass per sample. Silent modes are culled after each block.
+    void process(const T* in, T* const* out, int numSamples) {
+	   if (this->QM_mode) {
+		  Base::process(in, out, numSamples);
+		  return;
+	   }
+	   prepareBlock(in, numSamples);
+	   processActiveModes(in, out, numSamples);
+    }
+
+    // Same, but with the active modes split into partitions of partitionChunks chunks which are advanced
+    // and evaluated independently. parallelFor(n, task, context) needs to call task(context, p) once for
+    // every p in [0, n), in any order and on any thread. The partial sums of the partitions are added up
+    // afterwards in a fixed order, so the output only depends on the partitioning and not on how
+    // parallelFor runs the partitions. The partitions are cut from the chunks that are active in this
+    // block, once it is known which modes it strikes. Blocks with less than 2 partitions of active chunks
+    // are rendered on the calling thread. parallelFor returns once all partitions are done.
+    template <class ParallelFor>
+    void process(const T* in, T* const* out, int numSamples, ParallelFor&& parallelFor) {
+	   if (this->QM_mode) {
+		  Base::process(in, out, numSamples);
+		  return;
+	   }
+	   prepareBlock(in, numSamples);
+	   const int partitions = (this->numActiveChunks + partitionChunks - 1) / partitionChunks;
+	   if (partitions < 2) {
+		  processActiveModes(in, out, numSamples);
+		  return;
+	   }
+
+	   for (int start = 0; start < numSamples; start += partitionBlockSize) {
+		  const int n = std::min(partitionBlockSize, numSamples - start);
+		  partitionIn = in ? in + start : nullptr;
+		  partitionSamples = n;
+		  parallelFor(partitions, &EigenvalueProblemAmplitudeBase::partitionTask, this);
+		  for (int i = 0; i < numChannels; ++i) {
+			 for (int s = 0; s < n; ++s) {
+				T sum{ 0 };
+				for (int p = 0; p < partitions; ++p) sum += partialSums[(p * numChannels + i) * partitionBlockSize + s];
+				out[i][start + s] = sum;
+			 }
+		  }
+	   }
+	   this->advanceTime(numSamples);
+	   this->cullModes();
+    }
+
+    // Number of active chunks in a partition of the partitioned process() (128 modes)
+    static constexpr int partitionChunks = 8;
+
+protected:
+    void allocateModes(int capacity) {
+	   Base::allocateModes(capacity);
+	   amplitudesRe.resize(capacity);
+	   amplitudesIm.resize(capacity);
+	   const int maxPartitions = (capacity / modePadding + partitionChunks - 1) / partitionChunks;
+	   partialSums.resize(maxPartitions * numChannels * partitionBlockSize);
+    }
+
 private:
-    array<complex<T>, N> amplitudes{}; // all default initialized with 0
+    // The partitioned process() renders in blocks of this many samples
+    static constexpr int partitionBlockSize = 256;
+
+    // Step factors and the list of active chunks for a block with input in
+    void prepareBlock(const T* in, int numSamples) {
+	   this->prepareStepFactors();
+	   if (in && std::any_of(in, in + numSamples, [](T x) { return x != T{ 0 }; })) {
+		  this->activateStruckModes();
+	   }
+	   this->prepareActiveModes();
+    }
+
+    // Render a block with all active modes on the calling thread
+    void processActiveModes(const T* in, T* const* out, int numSamples) {
+	   const T* listen[numChannels];
+	   for (int i = 0; i < numChannels; ++i) listen[i] = this->eigenFunctionEvaluations[i].data();
+	   const T* strike = in ? this->eigenFunctionEvaluation_strike.data() : nullptr;
+	   T result[numChannels];
+
+	   for (int s = 0; s < numSamples; ++s) {
+		  rotateAndEvaluate<T, numChannels>(amplitudesRe.data(), amplitudesIm.data(), this->stepFactorsRe.data(), this->stepFactorsIm.data(),
+			 strike, in ? in[s] : T{ 0 }, listen, result, this->activeChunks.data(), this->numActiveChunks);
+		  for (int i = 0; i < numChannels; ++i) out[i][s] = result[i];
+	   }
+	   this->advanceTime(numSamples);
+	   this->cullModes();
+    }
+
+    // Render the current block (partitionIn, partitionSamples) of partition p, called by parallelFor
+    static void partitionTask(void* context, int p) {
+	   auto* self = static_cast<EigenvalueProblemAmplitudeBase*>(context);
+	   self->processPartition(p, self->partitionIn, self->partitionSamples);
+    }
+
+    // Render n samples of partition p into its rows of partialSums
+    void processPartition(int p, const T* in, int n) {
+	   const T* listen[numChannels];
+	   for (int i = 0; i < numChannels; ++i) listen[i] = this->eigenFunctionEvaluations[i].data();
+	   const T* strike = in ? this->eigenFunctionEvaluation_strike.data() : nullptr;
+	   const int* chunks = this->activeChunks.data() + p * partitionChunks;
+	   const int numChunks = std::min(partitionChunks, this->numActiveChunks - p * partitionChunks);
+	   T* partial = partialSums.data() + p * numChannels * partitionBlockSize;
+	   T result[numChannels];
+
+	   for (int s = 0; s < n; ++s) {
+		  rotateAndEvaluate<T, numChannels>(amplitudesRe.data(), amplitudesIm.data(), this->stepFactorsRe.data(), this->stepFactorsIm.data(),
+			 strike, in ? in[s] : T{ 0 }, listen, result, chunks, numChunks);
+		  for (int i = 0; i < numChannels; ++i) partial[i * partitionBlockSize + s] = result[i];
+	   }
+    }
+
+    // Complex amplitudes as structure of arrays, all initialized with 0
+    AlignedBuffer<T> amplitudesRe;
+    AlignedBuffer<T> amplitudesIm;
+
+    // Partial sums of the channels of every partition
+    AlignedBuffer<T> partialSums;
+    // Input and length of the block that the partitions are rendering, parallelFor only passes this to them
+    const T* partitionIn = nullptr;
+    int partitionSamples = 0;
 };
 
 
@@ -384,22 +837,23 @@ private:
  * Implementation of the eigenvalue problem of a 1D string with fixed length. The eigenfunctions and
  * -values are similar and need not be declared separately. The weights are initialized with zero.
  */
-template <class T, int N, int numChannels>
-class StringEigenvalueProblem : public EigenvalueProblemAmplitudeBase<T, 1, N, numChannels>
+template <class T, int numChannels>
+class StringEigenvalueProblem : public EigenvalueProblemAmplitudeBase<StringEigenvalueProblem<T, numChannels>, T, 1, numChannels>
 {
 public:
     StringEigenvalueProblem(T length = 1) : length(length) {}
 
-    T eigenFunction(int i, const Vector<T, 1> x) const override {
+    T eigenFunction(int i, const Vector<T, 1> x) const {
 	   return std::sin((i + 1) * pi<T>() * x[0] / length); // sin(2π·x/2L)
     }
-    T eigenValue_sqrt(int i) const override {
+    T eigenValue_sqrt(int i) const {
 	   return (i + 1) * pi<T>() / length;
     }
     T getLength() const { return length; }
 
     void setLength(T length) {
 	   this->length = length;
+	   this->eigenvaluesChanged();
     }
 
 private:
@@ -414,9 +868,12 @@ private:
  * Warning: This is currently a 3D sphere. The Parameter d is just a dummy to make it compatible with
  * an n-dimensional cube etc.
  */
-template <class T, int d, int N, int numChannels>
-class SphereEigenvalueProblem : public EigenvalueProblemAmplitudeBase<T, d, N, numChannels>
+template <class T, int d, int numChannels>
+class SphereEigenvalueProblem : public EigenvalueProblemAmplitudeBase<SphereEigenvalueProblem<T, d, numChannels>, T, d, numChannels>
 {
+    using Base = EigenvalueProblemAmplitudeBase<SphereEigenvalueProblem<T, d, numChannels>, T, d, numChannels>;
+    friend EigenvalueProblem<SphereEigenvalueProblem<T, d, numChannels>, T, d>;
+    friend FixedListenerEigenvalueProblem<SphereEigenvalueProblem<T, d, numChannels>, T, d, numChannels>;
 public:
     SphereEigenvalueProblem() {}
 
@@ -424,8 +881,8 @@ public:
 	   return { std::sin(theta) * std::cos(phi),std::sin(theta) * std::sin(phi),std::cos(theta) };
     }
 
-    // Get m and l numbers from linear index i∈[0, n)
-    std::pair<int, int> linearIndex(int i) const {
+    // Get m and l numbers from linear index i∈[0, n). The modes use the tables built by allocateModes().
+    static std::pair<int, int> linearIndex(int i) {
 	   // i+1 = l²+l+1+m and m from -l to l
 	   // solve for l: √(i+1) -1 <= l <= √i
 	   // Then, calc m from l and i
@@ -434,29 +891,35 @@ public:
 	   return { l, m };
     }
 
-    int factorial(int n) const {
-	   return n <= 1 ? 1 : factorial(n - 1) * n;
+    // √((2l+1)/2 · (l-m)!/(l+m)!). The quotient of factorials is computed as a product so that it
+    // doesn't overflow for large l.
+    static double normalizer(int l, int m) {
+	   double quotient = 1;
+	   if (m >= 0)
+		  for (int k = l - m + 1; k <= l + m; ++k) quotient /= k;
+	   else
+		  for (int k = l + m + 1; k <= l - m; ++k) quotient *= k;
+	   return std::sqrt((2 * l + 1) / 2. * quotient);
     }
 
-    float normalizer(int l, int m) const {
-	   return(std::sqrt((2 * l + 1) / 2.f * factorial(l - m) / factorial(l + m)));
-    }
+    // Highest degree l of the modes that setMaxModes() allocated for
+    int getMaxDegree() const { return maxDegree; }
 
-    T eigenFunction(int i, const Vector<T, d> x) const override {
+    T eigenFunction(int i, const Vector<T, d> x) const {
 	   // indices:
-	   auto lm = linearIndex(i);
-	   int l = lm.first;
-	   int m = lm.second;
+	   int l = degrees[i];
+	   int m = orders[i];
 
 	   // spherical coordinates
 	   T r = x[0];
 	   T theta = x[1];
 	   T phi = x[2];
 
-	   T legend = static_cast<T>(VSTMath::assoc_legendre(l, m, std::cos(theta)));
+	   // evaluate in double precision, the factorials involved overflow float for high orders
+	   T legend = static_cast<T>(normalizers[i] * VSTMath::assoc_legendre(l, m, static_cast<double>(std::cos(theta))));
 
 	   // return only real part 
-	   return std::pow(r, l) / rsrqt2pi * normalizer(l, m) * legend * std::cos(m * phi);
+	   return std::pow(r, l) / rsrqt2pi * legend * std::cos(m * phi);
     }
 
     const T rsrqt2pi = std::sqrt(2 * pi<T>());
@@ -464,24 +927,78 @@ public:
     // k = ω/c
     // k = 2π/λ    ω=2πf=2π/T
 
-    T eigenValue_sqrt(int i) const override {
-	   int l = linearIndex(i).first;
+    T eigenValue_sqrt(int i) const {
+	   int l = degrees[i];
 	   return l * (l + 1);
 	   //return std::sqrt(l * (l + 1));
     }
 
+protected:
+    // Tabulate l, m and the normalizer of every mode the capacity allows, so that evaluating the
+    // eigenfunctions needs neither square roots nor the products of normalizer().
+    void allocateModes(int capacity) {
+	   Base::allocateModes(capacity);
+	   degrees.resize(capacity);
+	   orders.resize(capacity);
+	   normalizers.resize(capacity);
+	   maxDegree = 0;
+	   for (int i = 0; i < capacity; ++i) {
+		  const auto lm = linearIndex(i);
+		  degrees[i] = lm.first;
+		  orders[i] = lm.second;
+		  normalizers[i] = normalizer(lm.first, lm.second);
+		  maxDegree = lm.first;
+	   }
+	   legendreScratch.resize(VSTMath::assoc_legendre_count(maxDegree));
+	   radialPowers.resize(maxDegree + 1);
+	   azimuthalCosines.resize(maxDegree + 1);
+    }
+
+    // The modes are ordered like the output of assoc_legendre_normalized_all(), so one sweep up to the
+    // degree of the last mode yields all normalized Legendre factors at once. r^l and cos(mφ) only depend
+    // on l and |m| and are tabulated as well.
+    void evaluateEigenFunctions(const Vector<T, d>& x, T* out, [[maybe_unused]] int slot) {
+	   const int numModes = this->getNumModes();
+	   if (numModes == 0) return;
+	   const int L = degrees[numModes - 1];
+	   // evaluate in double precision like eigenFunction()
+	   VSTMath::assoc_legendre_normalized_all(L, static_cast<double>(std::cos(x[1])), legendreScratch.data());
+	   for (int l = 0; l <= L; ++l) {
+		  radialPowers[l] = std::pow(x[0], l);
+		  azimuthalCosines[l] = std::cos(l * x[2]);
+	   }
+	   for (int i = 0; i < numModes; ++i) {
+		  const T legend = static_cast<T>(legendreScratch[i]);
+		  out[i] = radialPowers[degrees[i]] / rsrqt2pi * legend * azimuthalCosines[std::abs(orders[i])];
+	   }
+    }
+
+private:
+    AlignedBuffer<int> degrees;
+    AlignedBuffer<int> orders;
+    AlignedBuffer<double> normalizers;
+    int maxDegree = 0;
+    // Scratch space of evaluateEigenFunctions()
+    AlignedBuffer<double> legendreScratch;
+    AlignedBuffer<double> radialPowers;
+    AlignedBuffer<T> azimuthalCosines;
 };
 
 
 
-template <class T, int d, int N, int numChannels>
-class CubeEigenvalueProblem : public EigenvalueProblemAmplitudeBase<T, d, N, numChannels> {
+template <class T, int d, int numChannels>
+class CubeEigenvalueProblem : public EigenvalueProblemAmplitudeBase<CubeEigenvalueProblem<T, d, numChannels>, T, d, numChannels> {
+    using Base = EigenvalueProblemAmplitudeBase<CubeEigenvalueProblem<T, d, numChannels>, T, d, numChannels>;
+    friend EigenvalueProblem<CubeEigenvalueProblem<T, d, numChannels>, T, d>;
+    friend FixedListenerEigenvalueProblem<CubeEigenvalueProblem<T, d, numChannels>, T, d, numChannels>;
 public:
     CubeEigenvalueProblem(int defaultActualDims = d) {
 	   actualDim = defaultActualDims;
 	   computeEigenvalues_and_ks();
     }
 
+    // Change the dimension and recompute the eigenvalues right away. This allocates and may take a while
+    // for many modes in high dimensions, so use setModeTable() on the audio thread.
     void setDimension(int dimension) {
 	   if (dimension > 10 || dimension < 1) return;
 	   if (actualDim != dimension) {
@@ -489,7 +1006,19 @@ public:
 		  computeEigenvalues_and_ks();
 	   }
     }
-protected:
+    int getDimension() const { return actualDim; }
+
+    // Adopt the first numModes entries of a table built with computeModeTable() for the given dimension.
+    // This only copies the table and doesn't allocate.
+    void setModeTable(int dimension, int numModes, const Vector<T, d + 1>* table) {
+	   if (dimension > 10 || dimension < 1) return;
+	   actualDim = dimension;
+	   pendingModeTable = table;
+	   this->setNumModes(numModes);
+	   // setNumModes() doesn't call back if the count is the same
+	   if (pendingModeTable) computeEigenvalues_and_ks();
+    }
+
     /*
 
 	d
@@ -502,71 +1031,162 @@ protected:
 			N Eigenwerte, aber N·d Quantenzahlen/Wellenzahlen
 
     */
-    void computeEigenvalues_and_ks() {
-	   int r = getRApprox();
-
-	   int maxNumEigenvalues = std::pow(r + 1, actualDim);
-	   //if (maxNumEigenvalues < N) throw std::exception("r<N");
+    // Write the wave vectors of the numModes lowest eigenvalues of the cube of the given dimension to
+    // table, sorted by eigenvalue. The last entry of each vector holds √λ. This allocates scratch memory
+    // and is meant to run outside of the audio thread.
+    //
+    // The lattice of wave vectors k ∈ {1,2,...}^dimension is enumerated best-first. Every k except (1,...,1)
+    // has exactly one parent, namely k with its last entry > 1 decremented. Children are only generated
+    // by incrementing that entry or one behind it, so each k is reached once. As incrementing only makes
+    // |k| larger, popping the smallest |k|² from a heap gives all k in ascending order. That takes
+    // O(N·d·log(N·d)) time independent of the size of the lattice region involved.
+    static void computeModeTable(int dimension, int numModes, Vector<T, d + 1>* table) {
+	   if (numModes <= 0) return;
+	   struct Node {
+		  int norm_sq;
+		  int lastIncremented; // index of the last entry > 1, 0 for (1,...,1)
+		  std::array<int, d> k;
+		  // ties are broken by k so that the order doesn't depend on the heap implementation
+		  bool operator>(const Node& other) const {
+			 return norm_sq != other.norm_sq ? norm_sq > other.norm_sq : k > other.k;
+		  }
+	   };
+	   std::vector<Node> heapStorage;
+	   heapStorage.reserve(static_cast<size_t>(numModes) * dimension + 1);
+	   std::priority_queue<Node, std::vector<Node>, std::greater<Node>> heap(std::greater<Node>(), std::move(heapStorage));
+
+	   Node first{ dimension, 0, {} };
+	   std::fill(first.k.begin(), first.k.begin() + dimension, 1);
+	   heap.push(first);
+
+	   for (int i = 0; i < numModes; ++i) {
+		  const Node node = heap.top();
+		  heap.pop();
+
+		  Vector<T, d + 1> kvec{}; // last entry holds |k|
+		  for (int j = 0; j < dimension; j++) kvec[j] = static_cast<T>(node.k[j]);
+		  kvec[d] = static_cast<T>(std::sqrt(node.norm_sq));
+		  table[i] = kvec;
+
+		  for (int j = node.lastIncremented; j < dimension; j++) {
+			 Node child = node;
+			 child.norm_sq += 2 * node.k[j] + 1; // (k+1)² - k²
+			 child.k[j] += 1;
+			 child.lastIncremented = j;
+			 heap.push(child);
+		  }
+	   }
+    }
 
-	   std::vector<Vector<T, d + 1>> kvecs(maxNumEigenvalues);
+protected:
+    void allocateModes(int capacity) {
+	   Base::allocateModes(capacity);
+	   ks_and_eigenvalues.resize(capacity);
+	   // no wave number can be larger than the number of modes
+	   sineRowLength = capacity + 1;
+	   sineTables.resize(Base::numSlots * d * sineRowLength);
+	   sineScratch.resize(sineRowLength);
+    }
+    void modeCountChanged() {
+	   computeEigenvalues_and_ks();
+    }
 
-	   for (int i = 0; i < maxNumEigenvalues; ++i) {
-		  Vector<T, d + 1> kvec{}; // last entry sums up the squares of the other entries
-		  int kindex = i;
-		  for (int j = 0; j < actualDim; j++) {
-			 kvec[j] = kindex % (r + 1) + 1;
-			 kindex /= (r + 1);
-			 kvec[d] += kvec[j] * kvec[j];
+    void computeEigenvalues_and_ks() {
+	   if (pendingModeTable) {
+		  std::copy(pendingModeTable, pendingModeTable + this->getNumModes(), ks_and_eigenvalues.begin());
+		  pendingModeTable = nullptr;
+	   }
+	   else {
+		  computeModeTable(actualDim, this->getNumModes(), ks_and_eigenvalues.data());
+	   }
+	   maxWaveNumber = 0;
+	   for (int i = 0; i < this->getNumModes(); ++i) {
+		  for (int j = 0; j < actualDim; ++j) {
+			 maxWaveNumber = std::max(maxWaveNumber, static_cast<int>(ks_and_eigenvalues[i][j]));
 		  }
-		  kvec[d] = static_cast<T>(std::sqrt(kvec[d]));
-
-		  kvecs[i] = kvec;
 	   }
+	   this->derived().eigenvaluesChanged();
+    }
 
-	   std::sort(kvecs.begin(), kvecs.end(), [](Vector<T, d + 1>& a, Vector<T, d + 1>& b) {return a[d] < b[d]; });
-	   std::copy(kvecs.begin(), kvecs.begin() + N, ks_and_eigenvalues.begin());
+    // The eigenfunctions are products of sin(k·π·x_j) with wave numbers k up to maxWaveNumber. Instead of
+    // d sines per mode we tabulate sin(k·π·x_j) for every axis and k, then multiply table entries. The
+    // tables are kept per slot for updateEigenFunctions().
+    void evaluateEigenFunctions(const Vector<T, d>& x, T* out, int slot) {
+	   if (this->getNumModes() == 0) return;
+	   for (int j = 0; j < actualDim; ++j) {
+		  fillSineTable(x[j], sineRow(slot, j), maxWaveNumber);
+	   }
+	   for (int i = 0; i < this->getNumModes(); ++i) {
+		  out[i] = productFromSineTables(i, slot);
+	   }
+	   incrementalUpdates[slot] = 0;
     }
-    /*
-    0000..
-    1000..
-    0100..
-    0010..
-	.
-	.
-    1100
-    0110
-	.
-	.
-    1110
-	.
-	.
-    1111
 
-    */
-    int getRApprox() {
-	   // N =!  V_sphere / 2^d
-	   // with
-	   //       | π^(d/2) r^d /(d/2)!               even d
-	   // V =   |
-	   //       | 2·(.5(d-1))!·(4π)^.5(d-1)r^d/d!   odd d 
-	   T r = 0;
-	   if (!(actualDim % 2)) { // even d
-		  r = 2 * std::pow(N / std::pow(pi<T>(), actualDim / 2) * factorial(actualDim / 2), T{ 1 } / actualDim);
-	   } // odd d
-	   else {
-		  r = 2 * std::pow(N / std::pow(4 * pi<T>(), (actualDim - 1) / 2) * factorial(actualDim) / factorial((actualDim - 1) / 2) / T{ 2 }, T{ 1 } / actualDim);
+    // If only a few coordinates changed, every evaluation is multiplied by sin(k·π·x_new)/sin(k·π·x_old)
+    // for each changed axis, which costs one division instead of a product over all axes. Modes where the
+    // old factor is (almost) zero are recomputed from the tables. To keep rounding errors from adding up,
+    // everything is recomputed from scratch every maxIncrementalUpdates updates.
+    void updateEigenFunctions(const Vector<T, d>& previous, const Vector<T, d>& x, T* out, int slot) {
+	   if (this->getNumModes() == 0) return;
+	   int changedAxes[d];
+	   int numChanged = 0;
+	   for (int j = 0; j < actualDim; ++j) {
+		  if (x[j] != previous[j]) changedAxes[numChanged++] = j;
+	   }
+	   if (numChanged == 0) return;
+	   if (2 * numChanged > actualDim || ++incrementalUpdates[slot] > maxIncrementalUpdates) {
+		  evaluateEigenFunctions(x, out, slot);
+		  return;
+	   }
+	   for (int c = 0; c < numChanged; ++c) {
+		  const int j = changedAxes[c];
+		  T* row = sineRow(slot, j);
+		  T* newRow = sineScratch.data();
+		  fillSineTable(x[j], newRow, maxWaveNumber);
+		  for (int i = 0; i < this->getNumModes(); ++i) {
+			 const int k = static_cast<int>(ks_and_eigenvalues[i][j]);
+			 if (std::abs(row[k]) > minDivisor) {
+				out[i] *= newRow[k] / row[k];
+			 }
+			 else {
+				// the other rows are up to date, swap in the new one for this mode
+				const T old = row[k];
+				row[k] = newRow[k];
+				out[i] = productFromSineTables(i, slot);
+				row[k] = old;
+			 }
+		  }
+		  std::copy(newRow, newRow + maxWaveNumber + 1, row);
 	   }
-	   // r = largest k we will get
-	   return static_cast<int>(std::ceil(r));
     }
 
+    T* sineRow(int slot, int axis) { return sineTables.data() + (slot * d + axis) * sineRowLength; }
+    T productFromSineTables(int i, int slot) {
+	   T result{ 1 };
+	   for (int j = 0; j < actualDim; ++j) {
+		  result *= sineRow(slot, j)[static_cast<int>(ks_and_eigenvalues[i][j])];
+	   }
+	   return result;
+    }
 
-    int factorial(int n) const {
-	   return n <= 1 ? 1 : factorial(n - 1) * n;
+    // table[k] = sin(k·π·x) for k = 0..maxK through sin((k+1)θ) = 2·cos θ·sin kθ - sin (k-1)θ. This needs
+    // only two transcendental calls, double precision keeps the error small for large k.
+    static void fillSineTable(T x, T* table, int maxK) {
+	   const double theta = pi<double>() * x;
+	   const double twoCos = 2 * std::cos(theta);
+	   double previous = 0;
+	   double current = std::sin(theta);
+	   table[0] = T{ 0 };
+	   for (int k = 1; k <= maxK; ++k) {
+		  table[k] = static_cast<T>(current);
+		  const double next = twoCos * current - previous;
+		  previous = current;
+		  current = next;
+	   }
     }
 
-protected:
-    T eigenFunction(int i, const Vector<T, d> x) const override {
+public:
+    T eigenFunction(int i, const Vector<T, d> x) const {
 	   T result{ 1 };
 	   for (int j = 0; j < actualDim; ++j) {
 		  result *= std::sin(ks_and_eigenvalues[i][j] * pi<T>() * x[j]);
@@ -574,34 +1194,55 @@ protected:
 	   return result;
     }
 
-    T eigenValue_sqrt(int i) const override {
+    T eigenValue_sqrt(int i) const {
 	   return ks_and_eigenvalues[i][d];
     }
 
 //private:
     public:
-    array<Vector<T, d + 1>, N> ks_and_eigenvalues{};
+    std::vector<Vector<T, d + 1>> ks_and_eigenvalues;
     int actualDim = d;
+
+private:
+    const Vector<T, d + 1>* pendingModeTable = nullptr;
+    int maxWaveNumber = 0;
+    // sin(k·π·x_j) for every slot and axis, rows of sineRowLength entries of which maxWaveNumber + 1 are used
+    AlignedBuffer<T> sineTables;
+    AlignedBuffer<T> sineScratch;
+    int sineRowLength = 0;
+
+    static constexpr int maxIncrementalUpdates = 32;
+    static constexpr T minDivisor = T{ 1e-4 };
+    array<int, Base::numSlots> incrementalUpdates{};
 };
 
 /*
  * Implementation that allows to set specific eigenfunctions and values.
  */
-template <class T, int d, int N, int numChannels, class F>
-class IndividualFunctionEigenvalueProblem : public EigenvalueProblemAmplitudeBase<T, d, N, numChannels>
+template <class T, int d, int numChannels, class F>
+class IndividualFunctionEigenvalueProblem : public EigenvalueProblemAmplitudeBase<IndividualFunctionEigenvalueProblem<T, d, numChannels, F>, T, d, numChannels>
 {
+    using Base = EigenvalueProblemAmplitudeBase<IndividualFunctionEigenvalueProblem<T, d, numChannels, F>, T, d, numChannels>;
+    friend EigenvalueProblem<IndividualFunctionEigenvalueProblem<T, d, numChannels, F>, T, d>;
 public:
     IndividualFunctionEigenvalueProblem() {}
 
-    virtual T eigenFunction(int i, const Vector<T, 1> x) override {
+    T eigenFunction(int i, const Vector<T, d> x) const {
 	   return eigenFunctions[i](x);
     }
-    virtual T eigenValue_sqrt(int i) const override {
+    T eigenValue_sqrt(int i) const {
 	   return eigenValues_sq[i];
     }
 
-    array<F, N> eigenFunctions{};
-    array<T, N> eigenValues_sq{};
+    std::vector<F> eigenFunctions;
+    std::vector<T> eigenValues_sq;
+
+protected:
+    void allocateModes(int capacity) {
+	   Base::allocateModes(capacity);
+	   eigenFunctions.resize(capacity);
+	   eigenValues_sq.resize(capacity);
+    }
 };
 
 //for spherical eigenvalues need spherical coordinates and mapping function for indices
@@ -68,6 +68,12 @@ public:
 	inline double process (double sample);
 
 	inline void reset ();
+
+	// Normalized biquad coefficients of a filter of the given type (b0/a0, b1/a0, b2/a0, a1/a0, a2/a0)
+	static inline void computeCoefficients (Type type, double invSampleRate, double frequency, double q,
+	                                        double& b0a0, double& b1a0, double& b2a0, double& a1a0, double& a2a0);
+	// The output is set to zero below this (about -300 dB)
+	static constexpr double kStateFloor = 1e-15;
 protected:
 	Type type;
 
@@ -103,6 +109,13 @@ void Filter::setSampleRate (double _sampleRate)
 
 //-----------------------------------------------------------------------------
 void Filter::setFreqAndQ (double freq, double q)
+{
+	computeCoefficients (type, invSampleRate, freq, q, b0a0, b1a0, b2a0, a1a0, a2a0);
+}
+
+//-----------------------------------------------------------------------------
+void Filter::computeCoefficients (Type type, double invSampleRate, double freq, double q,
+                                  double& b0a0, double& b1a0, double& b2a0, double& a1a0, double& a2a0)
 {
 	static const double M_LOG2 = log (2.0);
 
@@ -175,6 +188,9 @@ void Filter::setFreqAndQ (double freq, double q)
 double Filter::process (double sample)
 {
 	double output = b0a0 * sample + b1a0 * in1 + b2a0 * in2 - a1a0 * out1 - a2a0 * out2;
+	// the feedback would otherwise decay into the denormal range after the input stopped
+	if (std::abs (output) < kStateFloor)
+		output = 0.;
 	in2 = in1;
 	in1 = sample;
 	out2 = out1;
@@ -0,0 +1,183 @@
+#pragma once
+
+
+/*
+ * Filters of all voices in one bank
+ *
+ * Every voice owns a lane of the bank. The coefficients and states of all lanes are kept in arrays, so
+ * that process() can run SimdVector<double>::width voices per instruction. The input is interleaved by
+ * lane: sample i of lane l is at io[i * numLanes + l].
+ *
+ * The voices render in blocks of blockSize samples. While a filter is modulated, its voice asks for new
+ * coefficients once per sub-block of updateInterval samples with rampFreqAndQ(). The coefficients then
+ * move there linearly within that sub-block, so the sines and cosines of Filter::computeCoefficients()
+ * are only needed once per sub-block instead of once per sample.
+ */
+
+
+#ifndef __FILTER_BANK_H__
+#define __FILTER_BANK_H__
+
+#include "filter.h"
+#include "mode_kernel.h"
+#include <array>
+#include <cmath>
+
+
+namespace Steinberg {
+namespace Vst {
+namespace NoteExpressionSynth {
+
+
+template<int numLanes>
+class VoiceFilterBank
+{
+public:
+	static constexpr int blockSize = 64;
+	static constexpr int updateInterval = 16;
+	static constexpr int numSubBlocks = blockSize / updateInterval;
+
+	using V = VSTMath::SimdVector<double>;
+	static_assert(numLanes % V::width == 0, "the number of lanes needs to be a multiple of the SIMD width");
+
+	VoiceFilterBank() {
+		for (auto& c : coefficients) c.resize(numLanes);
+		for (auto& s : state) s.resize(numLanes);
+		for (auto& subBlock : targets)
+			for (auto& c : subBlock) c.resize(numLanes);
+		types.fill(Filter::kLowpass);
+		for (int lane = 0; lane < numLanes; ++lane) reset(lane);
+	}
+
+	void setSampleRate(double sampleRate) { invSampleRate = 1. / sampleRate; }
+	void setType(int lane, Filter::Type type) { types[lane] = type; }
+
+	// Clear the state of a lane and make it pass everything through
+	void reset(int lane) {
+		for (auto& s : state) s[lane] = 0.;
+		for (auto& c : coefficients) c[lane] = 0.;
+		coefficients[b0][lane] = 1.;
+		for (auto& pending : rampPending) pending[lane] = false;
+	}
+
+	// Set the coefficients of a lane right away, cancelling pending ramps
+	void setFreqAndQ(int lane, double frequency, double q) {
+		Filter::computeCoefficients(types[lane], invSampleRate, frequency, q, coefficients[b0][lane], coefficients[b1][lane],
+			coefficients[b2][lane], coefficients[a1][lane], coefficients[a2][lane]);
+		for (auto& pending : rampPending) pending[lane] = false;
+	}
+
+	// Ramp the coefficients of a lane to frequency and q during sub-block subBlock of the next process() call
+	void rampFreqAndQ(int lane, int subBlock, double frequency, double q) {
+		auto& target = targets[subBlock];
+		Filter::computeCoefficients(types[lane], invSampleRate, frequency, q, target[b0][lane], target[b1][lane],
+			target[b2][lane], target[a1][lane], target[a2][lane]);
+		rampPending[subBlock][lane] = true;
+	}
+
+	// Filter numSamples (at most blockSize) interleaved samples of the lanes [beginLane, endLane) in place.
+	// The range needs to be aligned to the SIMD width. Lanes of groups in which no lane is active are
+	// skipped, inactive lanes in the other groups need to be fed silence.
+	void process(double* io, int numSamples, const bool* active, int beginLane = 0, int endLane = numLanes) {
+		for (int group = beginLane; group < endLane; group += V::width) {
+			bool any = false;
+			for (int lane = group; lane < group + V::width; ++lane) any |= active[lane];
+			if (any) processGroup(io, numSamples, group);
+		}
+	}
+
+	// Filter numSamples (at most blockSize) samples of a single lane in place
+	void processLane(int lane, double* io, int numSamples) {
+		double c[numCoefficients], step[numCoefficients];
+		for (int k = 0; k < numCoefficients; ++k) c[k] = coefficients[k][lane];
+		double x1 = state[in1][lane], x2 = state[in2][lane], y1 = state[out1][lane], y2 = state[out2][lane];
+		for (int start = 0, subBlock = 0; start < numSamples; start += updateInterval, ++subBlock) {
+			const int end = std::min(start + updateInterval, numSamples);
+			const bool ramp = rampPending[subBlock][lane];
+			for (int k = 0; k < numCoefficients; ++k) step[k] = ramp ? (targets[subBlock][k][lane] - c[k]) / updateInterval : 0.;
+			rampPending[subBlock][lane] = false;
+			for (int i = start; i < end; ++i) {
+				if (ramp)
+					for (int k = 0; k < numCoefficients; ++k) c[k] += step[k];
+				const double y = c[b0] * io[i] + c[b1] * x1 + c[b2] * x2 - c[a1] * y1 - c[a2] * y2;
+				x2 = x1;
+				x1 = io[i];
+				y2 = y1;
+				y1 = y;
+				io[i] = y;
+			}
+		}
+		for (int k = 0; k < numCoefficients; ++k) coefficients[k][lane] = c[k];
+		state[in1][lane] = x1; state[in2][lane] = x2; state[out1][lane] = y1; state[out2][lane] = y2;
+		floorState(lane);
+	}
+
+private:
+	enum { b0, b1, b2, a1, a2, numCoefficients };
+	enum { in1, in2, out1, out2, numStates };
+
+	void processGroup(double* io, int numSamples, int group) {
+		V c[numCoefficients], step[numCoefficients];
+		for (int k = 0; k < numCoefficients; ++k) c[k] = V::load(coefficients[k].data() + group);
+		V x1 = V::load(state[in1].data() + group), x2 = V::load(state[in2].data() + group);
+		V y1 = V::load(state[out1].data() + group), y2 = V::load(state[out2].data() + group);
+
+		for (int start = 0, subBlock = 0; start < numSamples; start += updateInterval, ++subBlock) {
+			const int end = std::min(start + updateInterval, numSamples);
+
+			// Per-lane increments towards the targets, zero for lanes without a ramp
+			bool ramp = false;
+			for (int lane = group; lane < group + V::width; ++lane) ramp |= rampPending[subBlock][lane];
+			if (ramp) {
+				alignas(VSTMath::modeAlignment) double current[numCoefficients][V::width];
+				for (int k = 0; k < numCoefficients; ++k) c[k].store(current[k]);
+				for (int k = 0; k < numCoefficients; ++k) {
+					alignas(VSTMath::modeAlignment) double s[V::width];
+					for (int l = 0; l < V::width; ++l) {
+						const int lane = group + l;
+						s[l] = rampPending[subBlock][lane] ? (targets[subBlock][k][lane] - current[k][l]) / updateInterval : 0.;
+					}
+					step[k] = V::load(s);
+				}
+				for (int lane = group; lane < group + V::width; ++lane) rampPending[subBlock][lane] = false;
+			}
+
+			for (int i = start; i < end; ++i) {
+				if (ramp)
+					for (int k = 0; k < numCoefficients; ++k) c[k] = c[k] + step[k];
+				double* p = io + i * numLanes + group;
+				const V x = V::load(p);
+				const V y = c[b0] * x + c[b1] * x1 + c[b2] * x2 - c[a1] * y1 - c[a2] * y2;
+				x2 = x1;
+				x1 = x;
+				y2 = y1;
+				y1 = y;
+				y.store(p);
+			}
+		}
+
+		for (int k = 0; k < numCoefficients; ++k) c[k].store(coefficients[k].data() + group);
+		x1.store(state[in1].data() + group); x2.store(state[in2].data() + group);
+		y1.store(state[out1].data() + group); y2.store(state[out2].data() + group);
+		for (int lane = group; lane < group + V::width; ++lane) floorState(lane);
+	}
+
+	// Like Filter::process(), but once per block: the feedback would otherwise decay into the denormal
+	// range after the input of a lane stopped
+	void floorState(int lane) {
+		for (int s : { out1, out2 })
+			if (std::abs(state[s][lane]) < Filter::kStateFloor) state[s][lane] = 0.;
+	}
+
+	double invSampleRate = 1. / 44100.;
+	std::array<Filter::Type, numLanes> types;
+	std::array<VSTMath::AlignedBuffer<double>, numCoefficients> coefficients;
+	std::array<VSTMath::AlignedBuffer<double>, numStates> state;
+	std::array<std::array<VSTMath::AlignedBuffer<double>, numCoefficients>, numSubBlocks> targets;
+	std::array<std::array<bool, numLanes>, numSubBlocks> rampPending{};
+};
+
+}
+}
+} // namespaces
+#endif
@@ -16,6 +16,7 @@
 #ifndef __LEGENDRE_H__
 #define __LEGENDRE_H__
 
+#include <algorithm>
 #include <cmath>
 
 
@@ -102,10 +103,11 @@ inline T assoc_legendre_impl(int l, int m, T x, T sin_theta_power) {
 		return legendre(l, x);
 	}
 
-	T p0 = static_cast<T>(doublefactorial(2 * m - 1)) * sin_theta_power;
+	// (2m-1)!! in T, the unsigned version overflows for m > 10
+	T p0 = sin_theta_power;
+	for (int k = 2 * m - 1; k > 1; k -= 2)
+		p0 *= k;
 
-	if (m & 1)
-		p0 *= -1;
 	if (m == l)
 		return p0;
 	T p1 = x * (2 * m + 1) * p0;
@@ -116,10 +118,6 @@ inline T assoc_legendre_impl(int l, int m, T x, T sin_theta_power) {
 		p1 = assoc_legendre_next(n, m, x, p0, p1);
 		++n;
 	}
-
-	if ((m & 1u) != 0) {
-		p1 = -p1;
-	}
 	return p1;
 }
 
@@ -131,5 +129,89 @@ inline auto assoc_legendre(int l, int m, T x) noexcept {
 }
 
 
+// Position of P_l^m in the output of the sweeps below, the same order as the modes of a sphere
+constexpr int assoc_legendre_index(int l, int m) {
+	return l * l + l + m;
+}
+
+// Number of values a sweep up to degree L writes
+constexpr int assoc_legendre_count(int L) {
+	return (L + 1) * (L + 1);
+}
+
+// All associated Legendre polynoms P_l^m(x) with 0 <= l <= L and -l <= m <= l in one sweep. out needs
+// room for assoc_legendre_count(L) values, P_l^m ends up at assoc_legendre_index(l, m). Each m starts
+// from P_m^m = (2m-1)!! (1-x²)^(m/2) and runs the recurrence in l, the negative orders follow from
+// P_l^-m = (-1)^m (l-m)!/(l+m)! P_l^m. This takes O(L²) operations, but the values span many orders of
+// magnitude and overflow double for L beyond about 150. Prefer assoc_legendre_normalized_all().
+template<class T>
+inline void assoc_legendre_all(int L, T x, T* out) {
+	if (L < 0)
+		return;
+	const T s = std::sqrt(std::max(T{ 0 }, 1 - x * x));
+	T pmm = 1;
+	for (int m = 0; m <= L; ++m) {
+		if (m > 0)
+			pmm *= (2 * m - 1) * s;
+		out[assoc_legendre_index(m, m)] = pmm;
+		if (m == L)
+			break;
+		T p0 = pmm;
+		T p1 = x * (2 * m + 1) * pmm;
+		out[assoc_legendre_index(m + 1, m)] = p1;
+		for (int l = m + 2; l <= L; ++l) {
+			const T p2 = ((2 * l - 1) * x * p1 - (l + m - 1) * p0) / static_cast<T>(l - m);
+			out[assoc_legendre_index(l, m)] = p2;
+			p0 = p1;
+			p1 = p2;
+		}
+	}
+	for (int l = 1; l <= L; ++l) {
+		T ratio = 1; // (l-m)!/(l+m)!
+		for (int m = 1; m <= l; ++m) {
+			ratio /= static_cast<T>(l + m) * (l - m + 1);
+			const T value = ratio * out[assoc_legendre_index(l, m)];
+			out[assoc_legendre_index(l, -m)] = (m & 1) ? -value : value;
+		}
+	}
+}
+
+// Like assoc_legendre_all(), but every P_l^m is multiplied by √((2l+1)/2 · (l-m)!/(l+m)!), so that the
+// polynoms of each order are orthonormal on [-1, 1]. The recurrences run on the normalized values
+// directly, which stay of order one and don't overflow for any L:
+//
+//   P̄_0^0 = √(1/2),  P̄_m^m = √((2m+1)/(2m)) · √(1-x²) · P̄_{m-1}^{m-1},  P̄_{m+1}^m = √(2m+3) · x · P̄_m^m
+//   P̄_l^m = √((4l²-1)/(l²-m²)) · (x · P̄_{l-1}^m - √(((l-1)²-m²)/(4(l-1)²-1)) · P̄_{l-2}^m)
+//   P̄_l^-m = (-1)^m P̄_l^m
+template<class T>
+inline void assoc_legendre_normalized_all(int L, T x, T* out) {
+	if (L < 0)
+		return;
+	const T s = std::sqrt(std::max(T{ 0 }, 1 - x * x));
+	T pmm = std::sqrt(T{ 0.5 });
+	for (int m = 0; m <= L; ++m) {
+		if (m > 0)
+			pmm *= std::sqrt(static_cast<T>(2 * m + 1) / static_cast<T>(2 * m)) * s;
+		out[assoc_legendre_index(m, m)] = pmm;
+		if (m == L)
+			break;
+		T p0 = pmm;
+		T p1 = std::sqrt(static_cast<T>(2 * m + 3)) * x * pmm;
+		out[assoc_legendre_index(m + 1, m)] = p1;
+		for (int l = m + 2; l <= L; ++l) {
+			const T a = std::sqrt(static_cast<T>(4 * l * l - 1) / static_cast<T>(l * l - m * m));
+			const T b = std::sqrt(static_cast<T>((l - 1) * (l - 1) - m * m) / static_cast<T>(4 * (l - 1) * (l - 1) - 1));
+			const T p2 = a * (x * p1 - b * p0);
+			out[assoc_legendre_index(l, m)] = p2;
+			p0 = p1;
+			p1 = p2;
+		}
+	}
+	for (int l = 1; l <= L; ++l)
+		for (int m = 1; m <= l; ++m)
+			out[assoc_legendre_index(l, -m)] = (m & 1) ? -out[assoc_legendre_index(l, m)] : out[assoc_legendre_index(l, m)];
+}
+
+
 }
 #endif
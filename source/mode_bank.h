@@ -0,0 +1,188 @@
+#pragma once
+
+
+/*
+ * Modal resonators of all voices in one bank
+ *
+ * Every voice owns a lane of the bank. The complex amplitudes, step factors and listening evaluations of
+ * all lanes are kept per mode in arrays (structure of arrays), so that process() advances
+ * SimdVector<T>::width voices per instruction and no sum across the modes of a vector is needed. The
+ * output is interleaved by lane like in VoiceFilterBank: sample i of lane l is at getOutput(i, l).
+ *
+ * The voices configure their modes with an eigenvalue problem of their own and copy them to their lane
+ * with strike(), together with the eigenfunctions that all voices share. Afterwards only the bank advances
+ * them. Like EigenvalueProblem::cullModes(), modes that
+ * drop below the amplitude floor are set to zero after each block and the energy is summed up on the way.
+ */
+
+
+#ifndef __MODE_BANK_H__
+#define __MODE_BANK_H__
+
+#include "mode_kernel.h"
+#include <array>
+#include <algorithm>
+#include <limits>
+
+
+namespace Steinberg {
+namespace Vst {
+namespace NoteExpressionSynth {
+
+
+template<class T, int numLanes, int numModes>
+class VoiceModeBank
+{
+public:
+	static constexpr int blockSize = 64;
+
+	using V = VSTMath::SimdVector<T>;
+	static_assert(numLanes % V::width == 0, "the number of lanes needs to be a multiple of the SIMD width");
+
+	VoiceModeBank() {
+		for (auto& field : modes)
+			for (auto& m : field) m.resize(numLanes);
+		energy.fill(T{ 0 });
+		output.resize(blockSize * numLanes);
+	}
+
+	// Modes are set to zero once |amplitude| drops below this floor
+	void setAmplitudeFloor(T floor) { amplitudeFloor_sq = floor * floor; }
+
+	// Set all amplitudes of a lane to zero
+	void silence(int lane) {
+		for (int m = 0; m < numModes; ++m) modes[re][m][lane] = modes[im][m][lane] = T{ 0 };
+		energy[lane] = T{ 0 };
+	}
+
+	// Copy the step factors of system and the eigenfunctions at the listening position to a lane and strike
+	// it with amount times the eigenfunctions at the striking position (like pinchDelta()). The amplitudes
+	// that are left in the lane keep ringing with the new step factors.
+	template<class System>
+	void strike(int lane, System& system, const T* listening, const T* striking, T amount) {
+		const T* factorsRe = system.getStepFactorsRe();
+		const T* factorsIm = system.getStepFactorsIm();
+		const int belowNyquist = std::min(system.getNumModesBelowNyquist(), numModes);
+		for (int m = 0; m < numModes; ++m) {
+			modes[stepRe][m][lane] = factorsRe[m];
+			modes[stepIm][m][lane] = factorsIm[m];
+			modes[listen][m][lane] = listening[m];
+			if (m < belowNyquist)
+				modes[re][m][lane] += striking[m] * amount;
+			else
+				modes[re][m][lane] = modes[im][m][lane] = T{ 0 };
+		}
+		cull(lane);
+	}
+
+	// Total energy of the modes of a lane, updated after every block. Modes that don't oscillate (step
+	// factor 1) count as well: they don't decay and keep sounding as an offset, so a voice that only
+	// excites them must still get its release.
+	T getEnergy(int lane) const { return energy[lane]; }
+
+	// Output sample i of a lane of the last process() or processLane() call
+	T getOutput(int i, int lane) const { return output[i * numLanes + lane]; }
+
+	// Advance the lanes [beginLane, endLane) by numSamples (at most blockSize) steps. The range needs to be
+	// aligned to the SIMD width. Lanes of groups in which no lane is active are skipped, inactive lanes in
+	// the other groups need to be silent.
+	void process(int numSamples, const bool* active, int beginLane = 0, int endLane = numLanes) {
+		for (int group = beginLane; group < endLane; group += V::width) {
+			bool any = false;
+			for (int lane = group; lane < group + V::width; ++lane) any |= active[lane];
+			if (!any) continue;
+			processGroup(numSamples, group);
+			for (int lane = group; lane < group + V::width; ++lane)
+				if (active[lane]) cull(lane);
+		}
+	}
+
+	// Advance numSamples (at most blockSize) steps of a single lane
+	void processLane(int lane, int numSamples) {
+		T a[numModes], b[numModes];
+		for (int m = 0; m < numModes; ++m) {
+			a[m] = modes[re][m][lane];
+			b[m] = modes[im][m][lane];
+		}
+		for (int i = 0; i < numSamples; ++i) {
+			T acc{ 0 };
+			for (int m = 0; m < numModes; ++m) {
+				const T sr = modes[stepRe][m][lane], si = modes[stepIm][m][lane];
+				const T newRe = a[m] * sr - b[m] * si;
+				b[m] = a[m] * si + b[m] * sr;
+				a[m] = newRe;
+				acc = acc + newRe * modes[listen][m][lane];
+			}
+			output[i * numLanes + lane] = acc;
+		}
+		for (int m = 0; m < numModes; ++m) {
+			modes[re][m][lane] = a[m];
+			modes[im][m][lane] = b[m];
+		}
+		cull(lane);
+	}
+
+private:
+	enum { re, im, stepRe, stepIm, listen, numFields };
+
+	void processGroup(int numSamples, int group) {
+		V a[numModes], b[numModes], sr[numModes], si[numModes], l[numModes];
+		for (int m = 0; m < numModes; ++m) {
+			a[m] = V::load(modes[re][m].data() + group);
+			b[m] = V::load(modes[im][m].data() + group);
+			sr[m] = V::load(modes[stepRe][m].data() + group);
+			si[m] = V::load(modes[stepIm][m].data() + group);
+			l[m] = V::load(modes[listen][m].data() + group);
+		}
+		for (int i = 0; i < numSamples; ++i) {
+			V acc = V::broadcast(T{ 0 });
+			for (int m = 0; m < numModes; ++m) {
+				const V newRe = a[m] * sr[m] - b[m] * si[m];
+				b[m] = a[m] * si[m] + b[m] * sr[m];
+				a[m] = newRe;
+				acc = acc + newRe * l[m];
+			}
+			acc.store(output.data() + i * numLanes + group);
+		}
+		for (int m = 0; m < numModes; ++m) {
+			a[m].store(modes[re][m].data() + group);
+			b[m].store(modes[im][m].data() + group);
+		}
+	}
+
+	// Set the modes of a lane to zero that dropped below the floor (or out of the normal range of T), or
+	// all of them if none is above the floor, and sum up the energy of the rest.
+	void cull(int lane) {
+		const T snap_sq = std::max(amplitudeFloor_sq, std::numeric_limits<T>::min());
+		bool audible = false;
+		T sum{ 0 };
+		for (int m = 0; m < numModes; ++m) {
+			T& a = modes[re][m][lane];
+			T& b = modes[im][m][lane];
+			const T norm = a * a + b * b;
+			if (norm == T{ 0 }) continue;
+			if (norm < snap_sq) {
+				a = b = T{ 0 };
+				continue;
+			}
+			audible |= norm > amplitudeFloor_sq;
+			sum += norm;
+		}
+		if (!audible) {
+			silence(lane);
+			return;
+		}
+		energy[lane] = sum;
+	}
+
+	std::array<std::array<VSTMath::AlignedBuffer<T>, numModes>, numFields> modes;
+	std::array<T, numLanes> energy;
+	T amplitudeFloor_sq{ 0 };
+	// Output of the last block, interleaved by lane
+	VSTMath::AlignedBuffer<T> output;
+};
+
+}
+}
+} // namespaces
+#endif
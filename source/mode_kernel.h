@@ -0,0 +1,288 @@
+#pragma once
+
+
+/*
+ * SIMD kernel for the modal resonators in eigen_evaluator.h
+ *
+ * The complex mode amplitudes are stored as separate arrays of real and imaginary parts (structure of
+ * arrays). One call of rotateAndEvaluate() advances all modes by one time step and accumulates the
+ * deflection at every listening position in the same pass.
+ *
+ * The instruction set is chosen at compile time (AVX2 > SSE2 > NEON > scalar). All arrays passed to the
+ * kernel need to be aligned to modeAlignment bytes and padded to a multiple of modePadding elements.
+ * The padding has to be zero in the step factors so that it stays silent.
+ */
+
+
+#ifndef __MODE_KERNEL_H__
+#define __MODE_KERNEL_H__
+
+#include <algorithm>
+#include <new>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MODE_KERNEL_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+
+namespace VSTMath {
+
+
+// Alignment of all mode arrays in bytes (one cache line, enough for AVX-512 too)
+constexpr int modeAlignment = 64;
+// Mode arrays are padded to multiples of this many elements so that no kernel needs a remainder loop
+constexpr int modePadding = 16;
+
+constexpr int paddedModeCount(int n) {
+	return (n + modePadding - 1) / modePadding * modePadding;
+}
+
+
+// Zero-initialized heap array aligned to modeAlignment bytes. Its size is only changed by resize() which
+// allocates and must therefore not be called from the audio thread.
+template<class T>
+class AlignedBuffer
+{
+public:
+	AlignedBuffer() = default;
+	explicit AlignedBuffer(int size) { resize(size); }
+	~AlignedBuffer() { release(); }
+
+	AlignedBuffer(const AlignedBuffer&) = delete;
+	AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+	AlignedBuffer(AlignedBuffer&& other) noexcept { swap(other); }
+	AlignedBuffer& operator=(AlignedBuffer&& other) noexcept { swap(other); return *this; }
+
+	// Reallocate for newSize elements, all set to zero
+	void resize(int newSize) {
+		release();
+		if (newSize <= 0) return;
+		buffer = static_cast<T*>(::operator new[](sizeof(T) * newSize, std::align_val_t(modeAlignment)));
+		std::fill_n(buffer, newSize, T{});
+		count = newSize;
+	}
+
+	T* data() { return buffer; }
+	const T* data() const { return buffer; }
+	int size() const { return count; }
+	T& operator[](int i) { return buffer[i]; }
+	const T& operator[](int i) const { return buffer[i]; }
+
+	void swap(AlignedBuffer& other) noexcept {
+		std::swap(buffer, other.buffer);
+		std::swap(count, other.count);
+	}
+
+private:
+	void release() {
+		if (buffer) ::operator delete[](buffer, std::align_val_t(modeAlignment));
+		buffer = nullptr;
+		count = 0;
+	}
+
+	T* buffer = nullptr;
+	int count = 0;
+};
+
+
+// Thin wrapper around the native vector type. The scalar fallback has width 1.
+template<class T>
+struct SimdVector
+{
+	static constexpr int width = 1;
+	T v;
+
+	static SimdVector load(const T* p) { return { *p }; }
+	static SimdVector broadcast(T x) { return { x }; }
+	void store(T* p) const { *p = v; }
+	friend SimdVector operator+(SimdVector a, SimdVector b) { return { a.v + b.v }; }
+	friend SimdVector operator-(SimdVector a, SimdVector b) { return { a.v - b.v }; }
+	friend SimdVector operator*(SimdVector a, SimdVector b) { return { a.v * b.v }; }
+	T sum() const { return v; }
+};
+
+#if defined(__AVX2__)
+
+template<>
+struct SimdVector<float>
+{
+	static constexpr int width = 8;
+	__m256 v;
+
+	static SimdVector load(const float* p) { return { _mm256_load_ps(p) }; }
+	static SimdVector broadcast(float x) { return { _mm256_set1_ps(x) }; }
+	void store(float* p) const { _mm256_store_ps(p, v); }
+	friend SimdVector operator+(SimdVector a, SimdVector b) { return { _mm256_add_ps(a.v, b.v) }; }
+	friend SimdVector operator-(SimdVector a, SimdVector b) { return { _mm256_sub_ps(a.v, b.v) }; }
+	friend SimdVector operator*(SimdVector a, SimdVector b) { return { _mm256_mul_ps(a.v, b.v) }; }
+	float sum() const {
+		__m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+};
+
+template<>
+struct SimdVector<double>
+{
+	static constexpr int width = 4;
+	__m256d v;
+
+	static SimdVector load(const double* p) { return { _mm256_load_pd(p) }; }
+	static SimdVector broadcast(double x) { return { _mm256_set1_pd(x) }; }
+	void store(double* p) const { _mm256_store_pd(p, v); }
+	friend SimdVector operator+(SimdVector a, SimdVector b) { return { _mm256_add_pd(a.v, b.v) }; }
+	friend SimdVector operator-(SimdVector a, SimdVector b) { return { _mm256_sub_pd(a.v, b.v) }; }
+	friend SimdVector operator*(SimdVector a, SimdVector b) { return { _mm256_mul_pd(a.v, b.v) }; }
+	double sum() const {
+		__m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+	}
+};
+
+#elif defined(MODE_KERNEL_SSE2)
+
+template<>
+struct SimdVector<float>
+{
+	static constexpr int width = 4;
+	__m128 v;
+
+	static SimdVector load(const float* p) { return { _mm_load_ps(p) }; }
+	static SimdVector broadcast(float x) { return { _mm_set1_ps(x) }; }
+	void store(float* p) const { _mm_store_ps(p, v); }
+	friend SimdVector operator+(SimdVector a, SimdVector b) { return { _mm_add_ps(a.v, b.v) }; }
+	friend SimdVector operator-(SimdVector a, SimdVector b) { return { _mm_sub_ps(a.v, b.v) }; }
+	friend SimdVector operator*(SimdVector a, SimdVector b) { return { _mm_mul_ps(a.v, b.v) }; }
+	float sum() const {
+		__m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+		s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+		return _mm_cvtss_f32(s);
+	}
+};
+
+template<>
+struct SimdVector<double>
+{
+	static constexpr int width = 2;
+	__m128d v;
+
+	static SimdVector load(const double* p) { return { _mm_load_pd(p) }; }
+	static SimdVector broadcast(double x) { return { _mm_set1_pd(x) }; }
+	void store(double* p) const { _mm_store_pd(p, v); }
+	friend SimdVector operator+(SimdVector a, SimdVector b) { return { _mm_add_pd(a.v, b.v) }; }
+	friend SimdVector operator-(SimdVector a, SimdVector b) { return { _mm_sub_pd(a.v, b.v) }; }
+	friend SimdVector operator*(SimdVector a, SimdVector b) { return { _mm_mul_pd(a.v, b.v) }; }
+	double sum() const { return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v))); }
+};
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+template<>
+struct SimdVector<float>
+{
+	static constexpr int width = 4;
+	float32x4_t v;
+
+	static SimdVector load(const float* p) { return { vld1q_f32(p) }; }
+	static SimdVector broadcast(float x) { return { vdupq_n_f32(x) }; }
+	void store(float* p) const { vst1q_f32(p, v); }
+	friend SimdVector operator+(SimdVector a, SimdVector b) { return { vaddq_f32(a.v, b.v) }; }
+	friend SimdVector operator-(SimdVector a, SimdVector b) { return { vsubq_f32(a.v, b.v) }; }
+	friend SimdVector operator*(SimdVector a, SimdVector b) { return { vmulq_f32(a.v, b.v) }; }
+	float sum() const {
+		float32x2_t s = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+		return vget_lane_f32(vpadd_f32(s, s), 0);
+	}
+};
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+template<>
+struct SimdVector<double>
+{
+	static constexpr int width = 2;
+	float64x2_t v;
+
+	static SimdVector load(const double* p) { return { vld1q_f64(p) }; }
+	static SimdVector broadcast(double x) { return { vdupq_n_f64(x) }; }
+	void store(double* p) const { vst1q_f64(p, v); }
+	friend SimdVector operator+(SimdVector a, SimdVector b) { return { vaddq_f64(a.v, b.v) }; }
+	friend SimdVector operator-(SimdVector a, SimdVector b) { return { vsubq_f64(a.v, b.v) }; }
+	friend SimdVector operator*(SimdVector a, SimdVector b) { return { vmulq_f64(a.v, b.v) }; }
+	double sum() const { return vaddvq_f64(v); }
+};
+#endif
+
+#endif
+
+static_assert(modePadding % SimdVector<float>::width == 0, "mode padding needs to be a multiple of the SIMD width");
+static_assert(modePadding % SimdVector<double>::width == 0, "mode padding needs to be a multiple of the SIMD width");
+
+
+// One vector step of the kernels below: rotate width modes starting at j and accumulate their real parts.
+template<class T, int numChannels>
+inline void rotateAndAccumulate(SimdVector<T>* acc, T* re, T* im, const T* stepRe, const T* stepIm, const T* strike,
+	SimdVector<T> in, const T* const* listen, int j) {
+	using V = SimdVector<T>;
+	V a = V::load(re + j);
+	V b = V::load(im + j);
+	if (strike) a = a + V::load(strike + j) * in;
+	const V sr = V::load(stepRe + j);
+	const V si = V::load(stepIm + j);
+	const V newRe = a * sr - b * si;
+	const V newIm = a * si + b * sr;
+	newRe.store(re + j);
+	newIm.store(im + j);
+	for (int c = 0; c < numChannels; ++c) acc[c] = acc[c] + newRe * V::load(listen[c] + j);
+}
+
+/*
+ * Advance n (padded) modes by one time step and evaluate them at numChannels listening positions.
+ *
+ *  a_j  ← (a_j + strike_j·amplitudeIn) · step_j
+ *  out_c = Σ_j Re(a_j) · listen_c,j
+ *
+ * strike may be nullptr if there is no input. Eigenfunctions are real so only the real parts of the
+ * amplitudes contribute to the output.
+ */
+template<class T, int numChannels>
+inline void rotateAndEvaluate(T* re, T* im, const T* stepRe, const T* stepIm, const T* strike, T amplitudeIn,
+	const T* const* listen, T* out, int n) {
+	using V = SimdVector<T>;
+	V acc[numChannels];
+	for (int c = 0; c < numChannels; ++c) acc[c] = V::broadcast(0);
+	const V in = V::broadcast(amplitudeIn);
+
+	for (int j = 0; j < n; j += V::width) {
+		rotateAndAccumulate<T, numChannels>(acc, re, im, stepRe, stepIm, strike, in, listen, j);
+	}
+	for (int c = 0; c < numChannels; ++c) out[c] = acc[c].sum();
+}
+
+// Same, but only for the chunks of modePadding modes whose indices are listed in chunks[0, numChunks).
+template<class T, int numChannels>
+inline void rotateAndEvaluate(T* re, T* im, const T* stepRe, const T* stepIm, const T* strike, T amplitudeIn,
+	const T* const* listen, T* out, const int* chunks, int numChunks) {
+	using V = SimdVector<T>;
+	V acc[numChannels];
+	for (int c = 0; c < numChannels; ++c) acc[c] = V::broadcast(0);
+	const V in = V::broadcast(amplitudeIn);
+
+	for (int k = 0; k < numChunks; ++k) {
+		const int begin = chunks[k] * modePadding;
+		for (int j = begin; j < begin + modePadding; j += V::width) {
+			rotateAndAccumulate<T, numChannels>(acc, re, im, stepRe, stepIm, strike, in, listen, j);
+		}
+	}
+	for (int c = 0; c < numChannels; ++c) out[c] = acc[c].sum();
+}
+
+}
+#endif
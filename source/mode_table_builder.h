@@ -0,0 +1,106 @@
+#pragma once
+
+
+/*
+ * Background computation of cube mode tables
+ *
+ * Finding the lowest eigenvalues of an n-dimensional cube means enumerating and sorting a lattice which
+ * is far too slow (and allocates) for the audio thread. CubeModeTableBuilder does this on a worker thread.
+ * The audio thread posts the wanted dimension and mode count with request() and picks up finished
+ * tables with acquire()/release(). Both sides only use atomics, the audio thread never waits and makes no
+ * system calls. The worker polls for requests in short sleeps while there is nothing to do.
+ *
+ * There is a single table slot. The worker only writes it while it is released, the audio thread only
+ * reads it between acquire() and release(). Requests that come in while a table is pending are coalesced
+ * and built afterwards.
+ */
+
+
+#ifndef __MODE_TABLE_BUILDER_H__
+#define __MODE_TABLE_BUILDER_H__
+
+#include "eigen_evaluator.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+
+namespace VSTMath {
+
+
+template<class T, int d>
+class CubeModeTableBuilder
+{
+public:
+	struct Table
+	{
+		int dimension = 0;
+		int numModes = 0;
+		std::vector<Vector<T, d + 1>> modes;
+	};
+
+	~CubeModeTableBuilder() { stop(); }
+
+	// Allocate the table for up to maxModes modes and start the worker. Not to be called from the audio thread.
+	void start(int maxModes) {
+		stop();
+		table.modes.resize(maxModes);
+		requested.store(noRequest);
+		ready.store(false);
+		running.store(true);
+		worker = std::thread([this] { run(); });
+	}
+	void stop() {
+		running.store(false);
+		if (worker.joinable()) worker.join();
+	}
+
+	// Ask for a table. Replaces any request that hasn't been picked up by the worker yet.
+	void request(int dimension, int numModes) {
+		requested.store(dimension * requestStride + numModes, std::memory_order_release);
+	}
+
+	// Get the finished table or nullptr if there is none. A table must be given back with release().
+	const Table* acquire() const {
+		return ready.load(std::memory_order_acquire) ? &table : nullptr;
+	}
+	void release() {
+		ready.store(false, std::memory_order_release);
+	}
+
+private:
+	using Cube = CubeEigenvalueProblem<T, d, 1>;
+
+	// dimension and mode count are packed into one atomic int
+	static constexpr int requestStride = 1 << 16;
+	static constexpr int noRequest = -1;
+	// How often the idle worker looks for a request. A new table is crossfaded in anyway, a few
+	// milliseconds more don't matter.
+	static constexpr std::chrono::milliseconds pollInterval{ 5 };
+
+	void run() {
+		int built = noRequest;
+		while (running.load()) {
+			const int r = requested.load(std::memory_order_acquire);
+			if (r == built || ready.load(std::memory_order_acquire)) {
+				std::this_thread::sleep_for(pollInterval);
+				continue;
+			}
+			table.dimension = r / requestStride;
+			table.numModes = std::min<int>(r % requestStride, static_cast<int>(table.modes.size()));
+			Cube::computeModeTable(table.dimension, table.numModes, table.modes.data());
+			built = r;
+			ready.store(true, std::memory_order_release);
+		}
+	}
+
+	Table table;
+	std::thread worker;
+	std::atomic<int> requested{ noRequest };
+	std::atomic<bool> ready{ false };
+	std::atomic<bool> running{ false };
+};
+
+}
+#endif
@@ -17,6 +17,7 @@ void GlobalParameterState::defaultSettings() {
 	bypass = false;
 
 	noiseBuffer = nullptr;
+	voiceModeShapes = nullptr;
 	masterVolume = .81;
 	masterTuning = 0;
 	velToLevel = 1.;
@@ -45,22 +46,56 @@ void GlobalParameterState::defaultSettings() {
 	Y[0] = .7;
 	Y[1] = .22;
 	resonatorType = 1;
-	dimension = GlobalResonatorWrapper::defaultStartDim;
+	dimension = GlobalResonatorSettings::defaultStartDim;
 
 	attackTime = 0.0;
 	mix = 1.0;
+	numModes = GlobalResonatorSettings::defaultNumModes;
+	multiThreading = 0;
 
 
 	bypassSNA = 0;
 }
 
 
-void processParameters(Steinberg::Vst::IParamValueQueue* queue, GlobalParameterState& paramState, Processor& p) {
-	int32 sampleOffset;
+// Value of the queue at sampleOffset. Returns false if it didn't change since previousOffset.
+static bool getValueAt(Steinberg::Vst::IParamValueQueue* queue, int32 sampleOffset, int32 previousOffset, ParamValue& value) {
+	int32 numPoints = queue->getPointCount();
+	int32 firstOffset, lastOffset, offset0, offset1;
+	ParamValue firstValue, value0, value1;
+	if (numPoints <= 0 || queue->getPoint(0, firstOffset, firstValue) != kResultTrue || queue->getPoint(numPoints - 1, lastOffset, value) != kResultTrue)
+		return false;
+	// Nothing happens before the first point and after the last one the value is already set
+	if (sampleOffset < firstOffset || lastOffset <= previousOffset)
+		return false;
+
+	// The host ramps linearly between points
+	for (int32 i = 1; i < numPoints; ++i) {
+		queue->getPoint(i, offset1, value1);
+		if (offset1 > sampleOffset) {
+			queue->getPoint(i - 1, offset0, value0);
+			value = value0 + (value1 - value0) * (sampleOffset - offset0) / (offset1 - offset0);
+			break;
+		}
+	}
+	return true;
+}
+
+// Set target to value. Returns false if it already had that value, so that the derived state is only
+// updated when a ramp actually moves.
+template<class V>
+static bool update(V& target, V value) {
+	if (target == value)
+		return false;
+	target = value;
+	return true;
+}
+
+void processParameters(Steinberg::Vst::IParamValueQueue* queue, int32 sampleOffset, int32 previousOffset, GlobalParameterState& paramState, Processor& p) {
 	ParamValue value;
 	ParamID pid = queue->getParameterId();
 
-	if (queue->getPoint(queue->getPointCount() - 1, sampleOffset, value) == kResultTrue) {
+	if (getValueAt(queue, sampleOffset, previousOffset, value)) {
 		switch (pid) {
 
 		case kBypass: paramState.bypass = (value > 0.5f); break;
@@ -70,27 +105,27 @@ void processParameters(Steinberg::Vst::IParamValueQueue* queue, GlobalParameterS
 		case kParamVelToLevel: paramState.velToLevel = value; break;
 		case kParamFilterFreqModDepth: paramState.freqModDepth = 2 * (value - 0.5); break;
 
-		case kParamX0: paramState.X[0] = value; p.strikingPositionChanged(); break;
-		case kParamX1: paramState.X[1] = value; p.strikingPositionChanged(); break;
-		case kParamX2: paramState.X[2] = value; p.strikingPositionChanged(); break;
-		case kParamX3: paramState.X[3] = value; p.strikingPositionChanged(); break;
-		case kParamX4: paramState.X[4] = value; p.strikingPositionChanged(); break;
-		case kParamX5: paramState.X[5] = value; p.strikingPositionChanged(); break;
-		case kParamX6: paramState.X[6] = value; p.strikingPositionChanged(); break;
-		case kParamX7: paramState.X[7] = value; p.strikingPositionChanged(); break;
-		case kParamX8: paramState.X[8] = value; p.strikingPositionChanged(); break;
-		case kParamX9: paramState.X[9] = value; p.strikingPositionChanged(); break;
-
-		case kParamY0: paramState.Y[0] = value; p.listeningPositionChanged(); break;
-		case kParamY1: paramState.Y[1] = value; p.listeningPositionChanged(); break;
-		case kParamY2: paramState.Y[2] = value; p.listeningPositionChanged(); break;
-		case kParamY3: paramState.Y[3] = value; p.listeningPositionChanged(); break;
-		case kParamY4: paramState.Y[4] = value; p.listeningPositionChanged(); break;
-		case kParamY5: paramState.Y[5] = value; p.listeningPositionChanged(); break;
-		case kParamY6: paramState.Y[6] = value; p.listeningPositionChanged(); break;
-		case kParamY7: paramState.Y[7] = value; p.listeningPositionChanged(); break;
-		case kParamY8: paramState.Y[8] = value; p.listeningPositionChanged(); break;
-		case kParamY9: paramState.Y[9] = value; p.listeningPositionChanged(); break;
+		case kParamX0: if (update(paramState.X[0], value)) p.strikingPositionChanged(); break;
+		case kParamX1: if (update(paramState.X[1], value)) p.strikingPositionChanged(); break;
+		case kParamX2: if (update(paramState.X[2], value)) p.strikingPositionChanged(); break;
+		case kParamX3: if (update(paramState.X[3], value)) p.strikingPositionChanged(); break;
+		case kParamX4: if (update(paramState.X[4], value)) p.strikingPositionChanged(); break;
+		case kParamX5: if (update(paramState.X[5], value)) p.strikingPositionChanged(); break;
+		case kParamX6: if (update(paramState.X[6], value)) p.strikingPositionChanged(); break;
+		case kParamX7: if (update(paramState.X[7], value)) p.strikingPositionChanged(); break;
+		case kParamX8: if (update(paramState.X[8], value)) p.strikingPositionChanged(); break;
+		case kParamX9: if (update(paramState.X[9], value)) p.strikingPositionChanged(); break;
+
+		case kParamY0: if (update(paramState.Y[0], value)) p.listeningPositionChanged(); break;
+		case kParamY1: if (update(paramState.Y[1], value)) p.listeningPositionChanged(); break;
+		case kParamY2: if (update(paramState.Y[2], value)) p.listeningPositionChanged(); break;
+		case kParamY3: if (update(paramState.Y[3], value)) p.listeningPositionChanged(); break;
+		case kParamY4: if (update(paramState.Y[4], value)) p.listeningPositionChanged(); break;
+		case kParamY5: if (update(paramState.Y[5], value)) p.listeningPositionChanged(); break;
+		case kParamY6: if (update(paramState.Y[6], value)) p.listeningPositionChanged(); break;
+		case kParamY7: if (update(paramState.Y[7], value)) p.listeningPositionChanged(); break;
+		case kParamY8: if (update(paramState.Y[8], value)) p.listeningPositionChanged(); break;
+		case kParamY9: if (update(paramState.Y[9], value)) p.listeningPositionChanged(); break;
 
 
 		case kParamReleaseTime:
@@ -101,7 +136,7 @@ void processParameters(Steinberg::Vst::IParamValueQueue* queue, GlobalParameterS
 			paramState.resonanceFrequency = value; break;
 		case kParamDim:
 			//paramState.dimension = std::min<int8>((int8)round(9 * value + 1), 10); p.dimensionChanged(); break;
-			paramState.dimension = std::min<int8>(9, (int8)(value*(9+1)))+1; p.dimensionChanged(); break;
+			if (update(paramState.dimension, (int8)(std::min<int8>(9, (int8)(value*(9+1)))+1))) p.dimensionChanged(); break;
 		case kParamFilterType:
 			paramState.filterType = std::min<int8>((int8)(NUM_FILTER_TYPE * value), NUM_FILTER_TYPE - 1); break;
 
@@ -116,17 +151,21 @@ void processParameters(Steinberg::Vst::IParamValueQueue* queue, GlobalParameterS
 			break;
 
 		case kParamResonatorType:
-			paramState.resonatorType = value; p.resonatorTypeChanged();  break;
+			if (update(paramState.resonatorType, (int8)value)) p.resonatorTypeChanged(); break;
 		case kParamAttackTime:
 			paramState.attackTime = value; break;
 		case kParamMix:
 			paramState.mix = value; break;
+		case kParamNumModes:
+			if (update(paramState.numModes, std::min<int32>(maxNumModes - 1, (int32)(value * maxNumModes)) + 1)) p.numModesChanged(); break;
+		case kParamMultiThreading:
+			paramState.multiThreading = (value >= 0.5) ? 1 : 0; break;
 
 		}
 	}
 }
 
-static uint64 currentParamStateVersion = 7;
+static uint64 currentParamStateVersion = 9;
 
 tresult GlobalParameterState::setState(IBStream* stream)
 {
@@ -221,6 +260,22 @@ tresult GlobalParameterState::setState(IBStream* stream)
 		if (!s.readDouble(attackTime)) return kResultFalse;
 		if (!s.readDouble(mix))	return kResultFalse;
 	}
+	if (version >= 8)
+	{
+		if (!s.readInt32(numModes)) return kResultFalse;
+	}
+	else
+	{
+		numModes = GlobalResonatorSettings::defaultNumModes;
+	}
+	if (version >= 9)
+	{
+		if (!s.readInt8(multiThreading)) return kResultFalse;
+	}
+	else
+	{
+		multiThreading = 0;
+	}
 	return kResultTrue;
 }
 
@@ -312,6 +367,12 @@ tresult GlobalParameterState::getState(IBStream* stream)
 	if (!s.writeDouble(attackTime)) return kResultFalse;
 	if (!s.writeDouble(mix))	return kResultFalse;
 
+	// version 8
+	if (!s.writeInt32(numModes)) return kResultFalse;
+
+	// version 9
+	if (!s.writeInt8(multiThreading)) return kResultFalse;
+
 	return kResultTrue;
 }
 
@@ -368,6 +429,10 @@ void initParameters(Steinberg::Vst::ParameterContainer& parameters) {
 	param->getInfo().stepCount = 9;
 	parameters.addParameter(param);
 
+	param = new RangeParameter(UString256("Modes"), Params::kParamNumModes, nullptr, 1, maxNumModes, GlobalResonatorSettings::defaultNumModes, maxNumModes - 1);
+	param->setPrecision(0);
+	parameters.addParameter(param);
+
 	parameters.addParameter(new RangeParameter(USTRING("Output Volume"), Params::kParamOutputVolume, nullptr, 0, 1, 0, 0, ParameterInfo::kIsReadOnly));
 
 
@@ -395,6 +460,9 @@ void initParameters(Steinberg::Vst::ParameterContainer& parameters) {
 
 	parameters.addParameter(USTRING("Bypass SNA"), nullptr, 1, 0, ParameterInfo::kCanAutomate, kParamBypassSNA);
 
+	// Not automatable: switching it on only starts the threads when the plugin is activated the next time
+	parameters.addParameter(USTRING("Multi-Threading"), nullptr, 1, 0, ParameterInfo::kNoFlags, kParamMultiThreading);
+
 	parameters.addParameter(new RangeParameter(USTRING("Active Voices"), kParamActiveVoices, nullptr, 0, MAX_VOICES, 0, MAX_VOICES, ParameterInfo::kIsReadOnly));
 
 	auto* tuningRangeParam = new StringListParameter(USTRING("Tuning Range"), kParamTuningRange, nullptr, ParameterInfo::kIsList);
@@ -465,6 +533,8 @@ tresult PLUGIN_API Controller::setComponentState(IBStream* state)
 
 		setParamNormalized(kParamAttackTime, gps.attackTime);
 		setParamNormalized(kParamMix, gps.mix);
+		setParamNormalized(kParamNumModes, plainParamToNormalized(kParamNumModes, gps.numModes));
+		setParamNormalized(kParamMultiThreading, gps.multiThreading);
 
 	}
 	return result;
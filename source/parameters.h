@@ -23,8 +23,11 @@ class IParamValueQueue;
 namespace Steinberg::Vst::NoteExpressionSynth {
 
 class Processor;
+class VoiceModeShapes;
 
 constexpr int maxDimension = 10;
+// Upper limit of the "Modes" parameter. The global resonators allocate this many modes in setActive().
+constexpr int maxNumModes = 2048;
 //-----------------------------------------------------------------------------
 // Global Parameters
 //-----------------------------------------------------------------------------
@@ -73,7 +76,8 @@ enum Params : Steinberg::Vst::ParamID
 	kParamOutputVolume,   // OUT
 	kParamAttackTime,
 	kParamMix,
-
+	kParamNumModes,
+	kParamMultiThreading,
 
 	kNumGlobalParameters
 };
@@ -83,6 +87,7 @@ struct GlobalParameterState
 {
 	bool bypass = false;
 	BrownNoise<float>* noiseBuffer;
+	const VoiceModeShapes* voiceModeShapes; // owned by the Processor, valid while it is active
 
 	ParamValue masterVolume;		// [0, +1]
 	ParamValue masterTuning;		// [-1, +1]
@@ -115,6 +120,8 @@ struct GlobalParameterState
 	ParamValue outputVolume;		// [0, +1] OUT
 	ParamValue attackTime;			// [0, +1]
 	ParamValue mix;					// [0, +1] // only Fx, 1 is 100% Wet
+	int32 numModes;					// {1,...,maxNumModes}
+	int8 multiThreading;			// {0, 1}, render on the shared WorkerPool
 
 	// All from [0, 1]
 	std::array<ParamValue, maxDimension> X; // input (striking) position in #N D
@@ -132,8 +139,12 @@ void initParameters(Steinberg::Vst::ParameterContainer& parameters);
 // Add all necessary note expressions to the NoteExpressionTypeContainer. Called from Controller
 //void initNoteExpressions(Steinberg::Vst::NoteExpressionTypeContainer& noteExpressionTypes);
 
-// Read parameters from queue and write the values to a GlobalParameterState. Called from Processor
-void processParameters(Steinberg::Vst::IParamValueQueue* queue, GlobalParameterState& paramState, Processor& p);
+// Read the value of queue at sampleOffset and write it to a GlobalParameterState. Called from Processor
+// at the start of every sub-block, previousOffset is the start of the last one (-1 for the first).
+// The value is only written if it changed since then.
+// Changes that need more work than storing the value are only reported to the Processor, which
+// updates everything depending on them once per sub-block.
+void processParameters(Steinberg::Vst::IParamValueQueue* queue, int32 sampleOffset, int32 previousOffset, GlobalParameterState& paramState, Processor& p);
 
 
 }
\ No newline at end of file
@@ -36,11 +36,14 @@
 
 #include "processor.h"
 #include "public.sdk/samples/vst/common/voiceprocessor.h"
+#include "voice_bank.h"
 #include "controller.h"
 #include "pluginterfaces/base/ustring.h"
 #include "pluginterfaces/vst/ivstparameterchanges.h"
 #include <algorithm>
+#include <limits>
 #include "parameters.h"
+#include "denormals.h"
 #include "pluginterfaces/vst/ivstparameterchanges.h"
 #include "public.sdk/source/vst/vstaudioprocessoralgo.h" // getChannelBuffersPointer()
 
@@ -85,10 +88,14 @@ tresult PLUGIN_API Processor::notify(IMessage* message)
 	{
 		const void* msgData;
 		uint32 msgSize;
-		if (attr->getBinary(MsgIDEvent, msgData, msgSize) == kResultTrue && msgSize == sizeof(Event))
+		if (attr->getBinary(MsgIDEvent, msgData, msgSize) == kResultTrue && msgSize % sizeof(ControllerEvent) == 0)
 		{
-			auto evt = reinterpret_cast<const Event*>(msgData);
-			controllerEvents.push(*evt);
+			auto events = reinterpret_cast<const ControllerEvent*>(msgData);
+			for (uint32 i = 0; i < msgSize / sizeof(ControllerEvent); ++i)
+			{
+				if (!controllerEvents.push(events[i]))
+					return kOutOfMemory; // the processor is not running, the rest of the batch is lost
+			}
 		}
 	}
 	return kResultTrue;
@@ -97,7 +104,17 @@ tresult PLUGIN_API Processor::notify(IMessage* message)
 //-----------------------------------------------------------------------------
 tresult PLUGIN_API Processor::setState(IBStream* state)
 {
-	return paramState.setState(state);
+	tresult result = paramState.setState(state);
+	if (result == kResultTrue)
+	{
+		// The loaded state bypasses processParameters(), so everything derived from it is outdated
+		strikingPositionChanged();
+		listeningPositionChanged();
+		resonatorTypeChanged();
+		dimensionChanged();
+		numModesChanged();
+	}
+	return result;
 }
 
 //-----------------------------------------------------------------------------
@@ -128,6 +145,12 @@ tresult PLUGIN_API Processor::canProcessSampleSize(int32 symbolicSampleSize)
 	return kResultFalse;
 }
 
+//-----------------------------------------------------------------------------
+uint32 PLUGIN_API Processor::getTailSamples()
+{
+	return tailSamples.load(std::memory_order_relaxed);
+}
+
 //-----------------------------------------------------------------------------
 tresult PLUGIN_API Processor::setActive(TBool state)
 {
@@ -135,19 +158,23 @@ tresult PLUGIN_API Processor::setActive(TBool state)
 	{
 		if (paramState.noiseBuffer == nullptr)
 			paramState.noiseBuffer = new BrownNoise<float>((int32)processSetup.sampleRate, (float)processSetup.sampleRate);
+		voiceModeShapes.setStrikingPosition(paramState.X);
+		voiceModeShapes.setListeningPosition(paramState.Y);
+		paramState.voiceModeShapes = &voiceModeShapes;
 		if (voiceProcessor == nullptr)
 		{
+			if (paramState.multiThreading)
+			{
+				const double blockPeriod = processSetup.sampleRate > 0 ? processSetup.maxSamplesPerBlock / processSetup.sampleRate : .01;
+				workerPool = WorkerPool::acquireShared(std::chrono::nanoseconds(static_cast<int64>(blockPeriod * 1e9)));
+			}
 			if (processSetup.symbolicSampleSize == kSample32)
 			{
-				voiceProcessor =
-					new VoiceProcessorImplementation<float, Voice<float>, 2, MAX_VOICES,
-					GlobalParameterState>((float)processSetup.sampleRate, &paramState);
+				voiceProcessor = new VoiceBankProcessor<float>((float)processSetup.sampleRate, &paramState, &parallelFor);
 			}
 			else if (processSetup.symbolicSampleSize == kSample64)
 			{
-				voiceProcessor =
-					new VoiceProcessorImplementation<double, Voice<double>, 2, MAX_VOICES,
-					GlobalParameterState>((float)processSetup.sampleRate, &paramState);
+				voiceProcessor = new VoiceBankProcessor<double>((float)processSetup.sampleRate, &paramState, &parallelFor);
 			}
 			else
 			{
@@ -156,12 +183,23 @@ tresult PLUGIN_API Processor::setActive(TBool state)
 		}
 
 		voiceProcessor->clearOutputNeeded(false);
-		systemWrapper.init((float)processSetup.sampleRate);
-		systemWrapper.updateStrikingPosition(paramState.X);
-		systemWrapper.updateListeningPosition(paramState.Y);
+		if (processSetup.symbolicSampleSize == kSample64)
+			setupResonator(systemWrapper64);
+		else
+			setupResonator(systemWrapper32);
+		splitPoints.reserve(2 + maxControllerEvents + maxSplitPoints + processSetup.maxSamplesPerBlock / automationGranularity);
+		uiEvents.reserve(maxControllerEvents);
+		previousBlockTime = 0;
+		hasHeldControllerEvent = false;
 	}
 	else
 	{
+		systemWrapper32.stopWorker();
+		systemWrapper64.stopWorker();
+		if (workerPool)
+			WorkerPool::releaseShared();
+		workerPool = nullptr;
+		parallelFor.workers = nullptr;
 		if (voiceProcessor)
 		{
 			delete voiceProcessor;
@@ -179,36 +217,113 @@ tresult PLUGIN_API Processor::setActive(TBool state)
 //-----------------------------------------------------------------------------
 tresult PLUGIN_API Processor::process(ProcessData& data)
 {
-	// TODO: maybe try to make this nearly sample accurate
-	if (data.inputParameterChanges)
+	VSTMath::ScopedFlushDenormals flushDenormals;
+	// One time budget for all the work this call gives to the workers. Switching multi-threading off takes
+	// effect right away, switching it on only once the pool has been acquired in setActive().
+	parallelFor.workers = paramState.multiThreading ? workerPool : nullptr;
+	parallelFor.deadline = WorkerPool::Clock::now() + std::chrono::nanoseconds(static_cast<int64>(std::max<int32>(data.numSamples, 0) * 1e9 / processSetup.sampleRate));
+
+	Event evt;
+	popControllerEvents(data.numSamples);
+
+	// flush mode
+	if (data.numOutputs < 1 || data.numSamples <= 0)
 	{
-		int32 count = data.inputParameterChanges->getParameterCount();
-		for (int32 i = 0; i < count; i++)
+		for (auto& uiEvent : uiEvents)
+			voiceProcessor->processEvent(uiEvent);
+		applyParameterChanges(data.inputParameterChanges, std::numeric_limits<int32>::max(), -1);
+		resolveDirtyState();
+		return kResultTrue;
+	}
+
+	collectSplitPoints(data);
+
+	// Every sub-block is rendered with its own ProcessData whose buffers point into the host buffers.
+	// Events are handed to the voice processor directly, they all sit at the start of a sub-block.
+	const int32 numInputChannels = data.numInputs > 0 ? std::min<int32>(data.inputs[0].numChannels, 2) : 0;
+	const int32 numOutputChannels = std::min<int32>(data.outputs[0].numChannels, 2);
+	const size_t sampleSize = data.symbolicSampleSize == kSample64 ? sizeof(Sample64) : sizeof(Sample32);
+	void** hostIn = data.numInputs > 0 ? getChannelBuffersPointer(processSetup, data.inputs[0]) : nullptr;
+	void** hostOut = getChannelBuffersPointer(processSetup, data.outputs[0]);
+	void* segmentIn[2] = {};
+	void* segmentOut[2] = {};
+	AudioBusBuffers inputBus, outputBus;
+	if (data.numInputs > 0)
+		inputBus = data.inputs[0];
+	outputBus = data.outputs[0];
+	inputBus.channelBuffers32 = (Sample32**)segmentIn;
+	outputBus.channelBuffers32 = (Sample32**)segmentOut;
+
+	ProcessData segment = data;
+	segment.inputs = data.numInputs > 0 ? &inputBus : nullptr;
+	segment.outputs = &outputBus;
+	segment.numInputs = std::min<int32>(data.numInputs, 1);
+	segment.numOutputs = 1;
+	segment.inputEvents = nullptr;
+	segment.inputParameterChanges = nullptr;
+	segment.outputParameterChanges = nullptr;
+
+	const int32 numEvents = data.inputEvents ? data.inputEvents->getEventCount() : 0;
+	uint64 silenceFlags = ~uint64(0);
+	tresult result = kResultTrue;
+	tresult resultAudio = kResultTrue;
+	int32 previousStart = -1;
+	// processAudio() sums up the levels of all sub-blocks
+	vuPPMOld = vuPPM;
+	vuPPM = 0;
+
+	for (size_t k = 0; k + 1 < splitPoints.size(); ++k)
+	{
+		const int32 start = splitPoints[k];
+		const int32 end = splitPoints[k + 1];
+
+		applyParameterChanges(data.inputParameterChanges, start, previousStart);
+		resolveDirtyState();
+
+		for (int32 i = 0; i < numEvents; ++i)
 		{
-			IParamValueQueue* queue = data.inputParameterChanges->getParameterData(i);
-			if (queue)
+			if (data.inputEvents->getEvent(i, evt) != kResultTrue)
+				continue;
+			const int32 offset = std::min<int32>(std::max<int32>(evt.sampleOffset, 0), data.numSamples - 1);
+			if (offset >= start && offset < end)
 			{
-				processParameters(queue, paramState, *this);
+				evt.sampleOffset = 0;
+				voiceProcessor->processEvent(evt);
+			}
+		}
+		for (auto& uiEvent : uiEvents)
+		{
+			if (uiEvent.sampleOffset >= start && uiEvent.sampleOffset < end)
+			{
+				evt = uiEvent;
+				evt.sampleOffset = 0;
+				voiceProcessor->processEvent(evt);
 			}
 		}
-	}
-	tresult result = kResultTrue;
-	Event evt;
-	while (controllerEvents.pop(evt))
-	{
-		voiceProcessor->processEvent(evt);
-	}
 
-	tresult resultAudio = processAudio(data);
-	// initialize audio output buffers
-	if (data.numOutputs < 1)
-		result = kResultTrue;
+		for (int32 c = 0; c < numInputChannels; ++c)
+			segmentIn[c] = (char*)hostIn[c] + start * sampleSize;
+		for (int32 c = 0; c < numOutputChannels; ++c)
+			segmentOut[c] = (char*)hostOut[c] + start * sampleSize;
+		outputBus.silenceFlags = 0;
+		segment.numSamples = end - start;
+
+		if (processAudio(segment) != kResultOk)
+			resultAudio = kResultFalse;
+		// The voices add into the buffers that processAudio() may have flagged as silent
+		const bool voicesSounding = voiceProcessor->getActiveVoices() > 0;
+		if (voiceProcessor->process(segment) != kResultTrue)
+			result = kResultFalse;
+		if (voicesSounding)
+			outputBus.silenceFlags = 0;
+		silenceFlags &= outputBus.silenceFlags;
+		previousStart = start;
+	}
+	// A channel is only silent if it was in every sub-block, after the voices were added. Only the
+	// channels of the stereo bus count (0x3).
+	data.outputs[0].silenceFlags = silenceFlags & ((uint64(1) << numOutputChannels) - 1);
+	vuPPM /= data.numSamples;
 
-	// flush mode
-	if (data.numOutputs < 1)
-		result = kResultTrue;
-	else
-		result = voiceProcessor->process(data);
 	if (result == kResultTrue)
 	{
 		if (data.outputParameterChanges)
@@ -226,15 +341,157 @@ tresult PLUGIN_API Processor::process(ProcessData& data)
 				}
 			}
 		}
-		if (voiceProcessor->getActiveVoices() == 0 && data.numOutputs > 0)
+	}
+	return result && resultAudio;
+}
+
+//-----------------------------------------------------------------------------
+void Processor::addSplitPoint(int32 sampleOffset)
+{
+	// Only with more than maxSplitPoints events and automation points in one block. A dropped point is
+	// rendered from the split point before it, so that event or parameter change comes early.
+	if (splitPoints.size() < splitPoints.capacity())
+		splitPoints.push_back(sampleOffset);
+}
+
+//-----------------------------------------------------------------------------
+void Processor::collectSplitPoints(ProcessData& data)
+{
+	// Points outside of the block (some hosts send those) are moved to its borders. Points are added by
+	// priority, so that what has to be exact is in before the capacity could run out: the events, then
+	// the automation points, and the ramp grid gets what is left.
+	const auto clampToBlock = [&](int32 offset) { return std::min<int32>(std::max<int32>(offset, 0), data.numSamples); };
+	const auto compact = [this]() {
+		std::sort(splitPoints.begin(), splitPoints.end());
+		splitPoints.erase(std::unique(splitPoints.begin(), splitPoints.end()), splitPoints.end());
+	};
+
+	splitPoints.clear();
+	addSplitPoint(0);
+	addSplitPoint(data.numSamples);
+	if (data.inputEvents)
+	{
+		Event evt;
+		int32 count = data.inputEvents->getEventCount();
+		for (int32 i = 0; i < count; i++)
 		{
-			data.outputs[0].silenceFlags = 0x11; // left and right channel are silent
+			if (data.inputEvents->getEvent(i, evt) == kResultTrue)
+				addSplitPoint(clampToBlock(evt.sampleOffset));
 		}
 	}
-	return result && resultAudio;
+	for (auto& uiEvent : uiEvents)
+		addSplitPoint(clampToBlock(uiEvent.sampleOffset));
+	compact();
+
+	// The parameters ramp between the first and the last point of their queues. One grid over the span
+	// of all ramps is enough, the values are interpolated at every split point anyway.
+	int32 rampBegin = data.numSamples, rampEnd = 0;
+	if (data.inputParameterChanges)
+	{
+		int32 count = data.inputParameterChanges->getParameterCount();
+		for (int32 i = 0; i < count; i++)
+		{
+			IParamValueQueue* queue = data.inputParameterChanges->getParameterData(i);
+			if (!queue)
+				continue;
+			int32 numPoints = queue->getPointCount();
+			int32 firstOffset = 0, offset = 0;
+			ParamValue value;
+			for (int32 j = 0; j < numPoints; j++)
+			{
+				if (queue->getPoint(j, offset, value) != kResultTrue)
+					continue;
+				offset = clampToBlock(offset);
+				if (j == 0)
+					firstOffset = offset;
+				addSplitPoint(offset);
+			}
+			if (numPoints > 1)
+			{
+				rampBegin = std::min(rampBegin, firstOffset);
+				rampEnd = std::max(rampEnd, offset);
+			}
+		}
+	}
+	compact();
+
+	// The grid only refines the ramps. If it doesn't fit (the host sends a larger block than it promised
+	// or very many automation points), it gets coarser.
+	if (rampEnd > rampBegin)
+	{
+		const int32 free = static_cast<int32>(splitPoints.capacity() - splitPoints.size());
+		int32 step = automationGranularity;
+		while (free > 0 && (rampEnd - rampBegin) / step > free)
+			step *= 2;
+		for (int32 t = (rampBegin / step + 1) * step; t < rampEnd; t += step)
+			addSplitPoint(t);
+		compact();
+	}
+}
+
+//-----------------------------------------------------------------------------
+void Processor::popControllerEvents(int32 numSamples)
+{
+	const int64 blockTime = controllerEventTime() - controllerEventLatency;
+	const double samplesPerNanosecond = processSetup.sampleRate * 1e-9;
+	uiEvents.clear();
+	while (uiEvents.size() < uiEvents.capacity())
+	{
+		if (!hasHeldControllerEvent && !controllerEvents.pop(heldControllerEvent))
+			break;
+		hasHeldControllerEvent = true;
+		// The UI sends its events in order, everything after this one belongs to a later block as well
+		if (previousBlockTime > 0 && heldControllerEvent.timestamp >= blockTime)
+			break;
+		Event& evt = heldControllerEvent.event;
+		const int64 sinceBlock = previousBlockTime > 0 ? heldControllerEvent.timestamp - previousBlockTime : 0;
+		evt.sampleOffset = static_cast<int32>(std::min<double>(std::max<double>(sinceBlock * samplesPerNanosecond, 0), std::max<int32>(numSamples - 1, 0)));
+		uiEvents.push_back(evt);
+		hasHeldControllerEvent = false;
+	}
+	previousBlockTime = blockTime;
+}
+
+//-----------------------------------------------------------------------------
+void Processor::applyParameterChanges(IParameterChanges* changes, int32 sampleOffset, int32 previousOffset)
+{
+	if (!changes)
+		return;
+	int32 count = changes->getParameterCount();
+	for (int32 i = 0; i < count; i++)
+	{
+		IParamValueQueue* queue = changes->getParameterData(i);
+		if (queue)
+		{
+			processParameters(queue, sampleOffset, previousOffset, paramState, *this);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+template<class SamplePrecision>
+void Processor::setupResonator(GlobalResonatorWrapper<SamplePrecision>& systemWrapper)
+{
+	systemWrapper.init((float)processSetup.sampleRate);
+	systemWrapper.setMaxBlockSize(processSetup.maxSamplesPerBlock);
+	systemWrapper.setMaxModes(maxNumModes, paramState.numModes, paramState.dimension);
+	systemWrapper.setParallelFor(&parallelFor);
+	systemWrapper.updateStrikingPosition(paramState.X);
+	systemWrapper.updateListeningPosition(paramState.Y);
+	updateTailSamples(systemWrapper);
 }
 
+//-----------------------------------------------------------------------------
 tresult PLUGIN_API Processor::processAudio(ProcessData& data)
+{
+	if (processSetup.symbolicSampleSize == kSample64)
+		return processAudio(data, systemWrapper64);
+	return processAudio(data, systemWrapper32);
+}
+
+//-----------------------------------------------------------------------------
+template<class SamplePrecision>
+tresult Processor::processAudio(ProcessData& data, GlobalResonatorWrapper<SamplePrecision>& systemWrapper)
 {
 
 	if (data.numInputs == 0 || data.numOutputs == 0)
@@ -262,11 +519,16 @@ tresult PLUGIN_API Processor::processAudio(ProcessData& data)
 		return kResultOk;
 	}
 
+	updateTailSamples(systemWrapper);
+
 	// Die Silence-Flags dienen nur der Optimierung. Man kann CPU sparen, wenn kein Signal anliegt
 	// Achtung dieses Plugin kann Audio produzieren (nachklingen), auch wenn kein Signal anliegt. 
+	// Whether the tail is over is decided by the energy of the resonator.
 	{
-		if (data.inputs[0].silenceFlags != 0 && vuPPM < 0.0001) {
-			data.outputs[0].silenceFlags = data.inputs[0].silenceFlags;
+		const uint64 allChannelsSilent = ((uint64)1 << numChannels) - 1;
+		if ((data.inputs[0].silenceFlags & allChannelsSilent) == allChannelsSilent && systemWrapper.isSilent()) {
+			systemWrapper.silence();
+			data.outputs[0].silenceFlags = allChannelsSilent;
 
 			for (int32 i = 0; i < numChannels; ++i) {
 				if (in[i] != out[i]) {
@@ -278,66 +540,106 @@ tresult PLUGIN_API Processor::processAudio(ProcessData& data)
 		data.outputs[0].silenceFlags = 0;
 	}
 
-	systemWrapper.setVelocity_sq({ (float)paramState.resonanceFrequency * 2000,(float)paramState.decay * 5 });
-
-	vuPPMOld = vuPPM;
 	int32 numSamples = data.numSamples;	 // Wie viele Samples hat der Buffer?
-	Sample32* sInL;
-	Sample32* sInR;
-	VSTMath::Vector <GlobalResonatorWrapper::type, GlobalResonatorWrapper::numChannels> tmp;
-	Sample32 pL, pR, avg;
-
-	float wet = paramState.mix;
-	float dry = 1.0f - wet;
-
-	for (int32 i = 0; i < numSamples; i++) {
-
-		sInL = (Sample32*)in[0] + i;
-		sInR = (Sample32*)in[1] + i;
-
-		tmp = systemWrapper.resonator->next((*sInL + *sInR) * .5f);
-
-		pL = (Sample32)systemWrapper.filter.process(tmp[0]) * paramState.masterVolume;
-		pR = (Sample32)systemWrapper.filterR.process(tmp[1]) * paramState.masterVolume;
-
-		*((Sample32*)out[0] + i) = pL * wet + dry * (*sInL);
-		*((Sample32*)out[1] + i) = pR * wet + dry * (*sInR);
+	SamplePrecision pL, pR;
+
+	SamplePrecision wet = (SamplePrecision)paramState.mix;
+	SamplePrecision dry = 1 - wet;
+	SamplePrecision masterVolume = (SamplePrecision)paramState.masterVolume;
+
+	// The resonator renders whole blocks. Hosts are allowed to send less than maxSamplesPerBlock,
+	// so we only need to split if one doesn't keep that promise.
+	SamplePrecision* resonatorIn = systemWrapper.inputBuffer.data();
+	SamplePrecision* resonatorOut[GlobalResonatorSettings::numChannels] = { systemWrapper.outputBuffers[0].data(), systemWrapper.outputBuffers[1].data() };
+	const int32 blockSize = systemWrapper.getMaxBlockSize();
+
+	for (int32 offset = 0; offset < numSamples; offset += blockSize) {
+		int32 blockSamples = std::min<int32>(blockSize, numSamples - offset);
+		SamplePrecision* sInL = (SamplePrecision*)in[0] + offset;
+		SamplePrecision* sInR = (SamplePrecision*)in[1] + offset;
+		SamplePrecision* sOutL = (SamplePrecision*)out[0] + offset;
+		SamplePrecision* sOutR = (SamplePrecision*)out[1] + offset;
+
+		for (int32 i = 0; i < blockSamples; i++) {
+			resonatorIn[i] = (sInL[i] + sInR[i]) * SamplePrecision(.5);
+		}
 
-		//avg = (std::abs(pL) + std::abs(pR)) * .5f;
-		vuPPM += std::abs(pL);
-		// response of system is sent to all output channels. 
-		//for (int32 j = 0; j < numChannels; j++) {
+		systemWrapper.process(resonatorIn, resonatorOut, blockSamples);
 
-		//	sOut = (Sample32*)out[j] + i;
-		//	*sOut = tmp;
+		for (int32 i = 0; i < blockSamples; i++) {
+			pL = (SamplePrecision)systemWrapper.filter.process(resonatorOut[0][i]) * masterVolume;
+			pR = (SamplePrecision)systemWrapper.filterR.process(resonatorOut[1][i]) * masterVolume;
 
-		//	if (tmp > 0) {
-		//		vuPPM += tmp;
-		//	}
-		//	else {
-		//		vuPPM -= tmp;
+			sOutL[i] = pL * wet + dry * sInL[i];
+			sOutR[i] = pR * wet + dry * sInR[i];
 
-		//	}
-		//}
+			vuPPM += std::abs(pL);
+		}
 	}
-	vuPPM /= numSamples;
 	return kResultOk;
 }
+
+//-----------------------------------------------------------------------------
+template<class SamplePrecision>
+void Processor::updateTailSamples(GlobalResonatorWrapper<SamplePrecision>& systemWrapper)
+{
+	systemWrapper.setVelocity_sq({ (SamplePrecision)paramState.resonanceFrequency * 2000,(SamplePrecision)paramState.decay * 5 });
+	const long long tail = systemWrapper.getTailSamples();
+	tailSamples.store(tail < 0 || tail >= kInfiniteTail ? kInfiniteTail : static_cast<uint32>(tail), std::memory_order_relaxed);
+}
 void Processor::strikingPositionChanged()
 {
-	systemWrapper.updateStrikingPosition(paramState.X);
+	dirtyFlags |= kStrikingPositionDirty;
 }
 void Processor::resonatorTypeChanged()
 {
-	systemWrapper.setResonator(static_cast<GlobalResonatorWrapper::ResonatorType>(paramState.resonatorType));
+	dirtyFlags |= kResonatorTypeDirty;
 }
 void Processor::listeningPositionChanged()
 {
-	systemWrapper.updateListeningPosition(paramState.Y);
+	dirtyFlags |= kListeningPositionDirty;
 }
 void Processor::dimensionChanged()
 {
-	systemWrapper.setDimension(paramState.dimension);
+	dirtyFlags |= kDimensionDirty;
+}
+void Processor::numModesChanged()
+{
+	dirtyFlags |= kNumModesDirty;
+}
+
+//-----------------------------------------------------------------------------
+void Processor::resolveDirtyState()
+{
+	// The host may send many queues per block, the derived state is only updated once for all of them.
+	if (dirtyFlags.load(std::memory_order_relaxed) == 0)
+		return;
+	const uint32 flags = dirtyFlags.exchange(0);
+	if (flags & kStrikingPositionDirty)
+		voiceModeShapes.setStrikingPosition(paramState.X);
+	if (flags & kListeningPositionDirty)
+		voiceModeShapes.setListeningPosition(paramState.Y);
+	if (processSetup.symbolicSampleSize == kSample64)
+		updateResonator(systemWrapper64, flags);
+	else
+		updateResonator(systemWrapper32, flags);
+}
+
+//-----------------------------------------------------------------------------
+template<class SamplePrecision>
+void Processor::updateResonator(GlobalResonatorWrapper<SamplePrecision>& systemWrapper, uint32 flags)
+{
+	if (flags & kResonatorTypeDirty)
+		systemWrapper.setResonator(static_cast<GlobalResonatorSettings::ResonatorType>(paramState.resonatorType));
+	if (flags & kDimensionDirty)
+		systemWrapper.setDimension(paramState.dimension);
+	if (flags & kNumModesDirty)
+		systemWrapper.setNumModes(paramState.numModes);
+	if (flags & kStrikingPositionDirty)
+		systemWrapper.updateStrikingPosition(paramState.X);
+	if (flags & kListeningPositionDirty)
+		systemWrapper.updateListeningPosition(paramState.Y);
+	updateTailSamples(systemWrapper);
 }
 } // NoteExpressionSynth
 } // Vst
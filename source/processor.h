@@ -39,6 +39,11 @@
 #include "public.sdk/source/vst/vstaudioeffect.h"
 #include "public.sdk/source/vst/utility/ringbuffer.h"
 #include "voice.h"
+#include "controller.h"
+#include "mode_table_builder.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <vector>
 
 namespace Steinberg {
 namespace Vst {
@@ -47,50 +52,166 @@ class VoiceProcessor;
 namespace NoteExpressionSynth {
 
 
+// Settings shared by the float and double versions of GlobalResonatorWrapper
+struct GlobalResonatorSettings {
+	enum class ResonatorType {
+		Sphere, Cube
+	};
+
+	static constexpr int numChannels = 2;
+	static constexpr int dim = maxDimension;
+	static constexpr int defaultStartDim = 5;
+	static constexpr int defaultNumModes = 7;
+	// Length of the crossfade between the cubes when the dimension or mode count changes
+	static constexpr float crossfadeTime = .02f;
+	// The resonator counts as silent once its energy falls below silenceThreshold² (about -100 dB)
+	static constexpr float silenceThreshold = 1e-5f;
+};
+
 /*
  * Wrapper class for a global eigenvalue problem system.
+ *
+ * The cube exists twice. Its mode tables are built on a worker thread, a new table goes into the idle
+ * cube which is then crossfaded in while the other one rings out.
+ *
+ * SamplePrecision is the sample type of the host, so the resonator renders straight into its buffers.
+ *
+ * Resonators with many modes are split into partitions which run on the WorkerPool, if there is one.
+ * The partitioning only depends on the active modes, so the output is the same with or without workers.
  */
-class GlobalResonatorWrapper {
+template<class SamplePrecision>
+class GlobalResonatorWrapper : public GlobalResonatorSettings {
 public:
 	GlobalResonatorWrapper() {
 		setResonator(ResonatorType::Cube);
 	}
 
-	enum class ResonatorType {
-		Sphere, Cube
-	};
-
 	// Set the object that the sound is fed into
 	void setResonator(ResonatorType ot) {
-		switch (ot) {
+		resonatorType = ot;
+	}
+
+	using type = SamplePrecision;
+	// Modes below this amplitude (about -120 dB relative to a full strike) are not processed anymore
+	static constexpr type amplitudeFloor = type(1e-6);
+	using Cube = VSTMath::CubeEigenvalueProblem<type, dim, numChannels>;
+	std::array<Cube, 2> cubes{ Cube{ defaultStartDim }, Cube{ defaultStartDim } };
+	int activeCube = 0;
+	VSTMath::CubeModeTableBuilder<type, dim> cubeTables;
+	int32 crossfadeLength = 0;
+	int32 crossfadeRemaining = 0;
+	VSTMath::SphereEigenvalueProblem<type, dim, numChannels> sphere;
+	Filter filter{ Filter::kHighpass }; // we need a fucking filter to keep our speakers from exploding because of the ultra low mega-bass
+	Filter filterR{ Filter::kHighpass }; 
+
+	ResonatorType resonatorType = ResonatorType::Cube;
+
+	// Threads for the partitions of large resonators, nullptr renders them on the calling thread
+	void setParallelFor(const ParallelFor* runner) {
+		parallelFor = runner;
+	}
+
+	// Render a block with the current resonator. The resonators are statically typed, so this is the only
+	// place where we dispatch on the type.
+	inline void process(const type* in, type* const* out, int32 numSamples) {
+		silenced = false;
+		acceptCubeModeTable();
+		const ParallelFor onCallingThread;
+		const ParallelFor& runner = parallelFor ? *parallelFor : onCallingThread;
+		switch (resonatorType) {
 		case ResonatorType::Cube:
-			resonator = &cube; break;
+			processCube(in, out, numSamples, runner); break;
 		case ResonatorType::Sphere:
-			resonator = &sphere; break;
+			sphere.process(in, out, numSamples, runner); break;
 		}
 	}
 
-	using type = float;
-	static constexpr int k = 7;
-	static constexpr int numChannels = 2;
-	static constexpr int dim = maxDimension;
-	static constexpr int defaultStartDim = 5;
-	VSTMath::CubeEigenvalueProblem<type, dim, k, numChannels> cube{ defaultStartDim };
-	VSTMath::SphereEigenvalueProblem<type, dim, k, numChannels> sphere;
-	Filter filter{ Filter::kHighpass }; // we need a fucking filter to keep our speakers from exploding because of the ultra low mega-bass
-	Filter filterR{ Filter::kHighpass }; 
+	// The input only goes to the active cube, the previous one is faded out while it rings out.
+	template<class Runner>
+	inline void processCube(const type* in, type* const* out, int32 numSamples, const Runner& parallelFor) {
+		cubes[activeCube].process(in, out, numSamples, parallelFor);
+		if (crossfadeRemaining == 0) return;
+
+		auto& previous = cubes[activeCube ^ 1];
+		type* previousOut[numChannels];
+		for (int c = 0; c < numChannels; ++c) previousOut[c] = crossfadeBuffers[c].data();
+		previous.process(nullptr, previousOut, numSamples, parallelFor);
 
-	VSTMath::FixedListenerEigenvalueProblem<type, dim, k, numChannels>* resonator;
+		const type fadeStep = type{ 1 } / crossfadeLength;
+		for (int32 i = 0; i < numSamples; ++i) {
+			const type gain = crossfadeRemaining * fadeStep;
+			for (int c = 0; c < numChannels; ++c) {
+				out[c][i] = out[c][i] * (1 - gain) + previousOut[c][i] * gain;
+			}
+			if (crossfadeRemaining > 0) --crossfadeRemaining;
+		}
+		if (crossfadeRemaining == 0) previous.silence();
+	}
 
+	// True if nothing audible is left: no crossfade is running and the energy of the resonator in use is
+	// below the silence threshold.
+	bool isSilent() {
+		if (silenced) return true;
+		if (crossfadeRemaining > 0) return false;
+		const type energy = resonatorType == ResonatorType::Cube ? cubes[activeCube].getEnergy() : sphere.getEnergy();
+		return energy < type(silenceThreshold) * type(silenceThreshold);
+	}
+	// Drop what is left of the tails, so that the next block starts from rest. Does nothing if already silent.
+	void silence() {
+		if (silenced) return;
+		for (auto& cube : cubes)
+			cube.silence();
+		sphere.silence();
+		crossfadeRemaining = 0;
+		filter.reset();
+		filterR.reset();
+		silenced = true;
+	}
+	// Samples until a full-scale mode of the resonator in use has decayed below the amplitude floor, -1 if
+	// the modes don't decay.
+	long long getTailSamples() {
+		return resonatorType == ResonatorType::Cube ? cubes[activeCube].getDecaySamples(1) : sphere.getDecaySamples(1);
+	}
+
+	// Move a finished mode table into the idle cube and start crossfading to it. Doesn't allocate.
+	void acceptCubeModeTable() {
+		if (crossfadeRemaining > 0) return; // one at a time, the table waits until the crossfade is done
+		const auto* table = cubeTables.acquire();
+		if (!table) return;
+		const auto& current = cubes[activeCube];
+		if (table->dimension != current.getDimension() || table->numModes != current.getNumModes()) {
+			auto& next = cubes[activeCube ^ 1];
+			next.silence();
+			next.setModeTable(table->dimension, table->numModes, table->modes.data());
+			activeCube ^= 1;
+			if (resonatorType == ResonatorType::Cube) {
+				crossfadeRemaining = crossfadeLength;
+			}
+			else {
+				cubes[activeCube ^ 1].silence(); // nobody listens, no need to fade
+			}
+		}
+		cubeTables.release();
+	}
+
+	// Request a new cube mode table from the worker. Safe to call from the audio thread.
 	void setDimension(int dimension) {
-		cube.setDimension(dimension);
+		dimension = std::clamp(dimension, 1, dim);
+		requestedDimension = dimension;
+		cubeTables.request(requestedDimension, requestedNumModes);
 	}
 
 	void init(float sampleRate) {
-		cube.setSampleRate(sampleRate);
+		for (auto& cube : cubes) {
+			cube.setSampleRate(sampleRate);
+			cube.setVelocity_sq({ 100,1 });
+			cube.setAmplitudeFloor(amplitudeFloor);
+		}
 		sphere.setSampleRate(sampleRate);
-		cube.setVelocity_sq({ 100,1 });
 		sphere.setVelocity_sq({ 100,1 });
+		sphere.setAmplitudeFloor(amplitudeFloor);
+		crossfadeLength = std::max<int32>(1, static_cast<int32>(crossfadeTime * sampleRate));
+		crossfadeRemaining = 0;
 		filter.setSampleRate(sampleRate);
 		filterR.setSampleRate(sampleRate);
 		filter.setFreqAndQ(VoiceStatics::freqLogScale.scale(.2), .8);
@@ -98,7 +219,8 @@ public:
 	}
 
 	inline void updateStrikingPosition(const std::array<ParamValue, maxDimension>& X) {
-		cube.setStrikingPosition({ X });
+		for (auto& cube : cubes)
+			cube.setStrikingPosition({ X });
 		sphere.setStrikingPosition({ X });
 		//cube.setStrikingPosition({ (float)X[0], (float)X[1], (float)X[2] , (float)X[3] });
 		//sphere.setStrikingPosition({ (float)X[0], (float)X[1], (float)X[2] , (float)X[3] });
@@ -107,7 +229,8 @@ public:
 
 		const VSTMath::Vector<type, maxDimension> y = Y;
 		const VSTMath::Vector<type, maxDimension> center(.5);
-		cube.setListeningPositions({ y, center * 2 - y });
+		for (auto& cube : cubes)
+			cube.setListeningPositions({ y, center * 2 - y });
 		sphere.setListeningPositions({ y, y * -1 });
 		//cube.setFirstListeningPosition({ Y });
 		//sphere.setFirstListeningPosition({ Y });
@@ -115,10 +238,63 @@ public:
 		//sphere.setFirstListeningPosition({ (float)Y[0],  (float)Y[1], (float)Y[2], (float)Y[3] });
 	}
 
-	inline void setVelocity_sq(std::complex<float> vel) {
-		cube.setVelocity_sq(vel);
+	inline void setVelocity_sq(std::complex<type> vel) {
+		for (auto& cube : cubes)
+			cube.setVelocity_sq(vel);
 		sphere.setVelocity_sq(vel);
 	}
+
+	// Allocate the mode storage of the resonators for up to maxModes modes, compute the initial cube
+	// tables right away and start the table worker. Not to be called from the audio thread.
+	void setMaxModes(int maxModes, int numModes, int dimension) {
+		cubeTables.stop();
+		requestedDimension = std::clamp(dimension, 1, dim);
+		requestedNumModes = std::clamp(numModes, 0, maxModes);
+		std::vector<VSTMath::Vector<type, dim + 1>> table(maxModes);
+		Cube::computeModeTable(requestedDimension, requestedNumModes, table.data());
+		for (auto& cube : cubes) {
+			cube.setMaxModes(maxModes);
+			cube.setModeTable(requestedDimension, requestedNumModes, table.data());
+			cube.silence();
+		}
+		crossfadeRemaining = 0;
+		sphere.setMaxModes(maxModes);
+		sphere.setNumModes(numModes);
+		cubeTables.start(maxModes);
+	}
+	// Stop the table worker. Not to be called from the audio thread.
+	void stopWorker() {
+		cubeTables.stop();
+	}
+	// Choose the number of modes within the allocated storage. This doesn't allocate, the cube gets its
+	// new table from the worker.
+	void setNumModes(int numModes) {
+		sphere.setNumModes(numModes);
+		requestedNumModes = numModes;
+		cubeTables.request(requestedDimension, requestedNumModes);
+	}
+
+	// Allocate the scratch buffers used for block processing. Not to be called from the audio thread.
+	void setMaxBlockSize(int32 maxSamples) {
+		maxBlockSize = std::max<int32>(maxSamples, 1);
+		inputBuffer.assign(maxBlockSize, 0);
+		for (auto& buffer : outputBuffers)
+			buffer.assign(maxBlockSize, 0);
+		for (auto& buffer : crossfadeBuffers)
+			buffer.assign(maxBlockSize, 0);
+	}
+	int32 getMaxBlockSize() const { return maxBlockSize; }
+
+	int32 maxBlockSize = 0;
+	std::vector<type> inputBuffer;
+	std::array<std::vector<type>, numChannels> outputBuffers;
+	std::array<std::vector<type>, numChannels> crossfadeBuffers;
+
+	int requestedDimension = defaultStartDim;
+	int requestedNumModes = defaultNumModes;
+	bool silenced = false;
+
+	const ParallelFor* parallelFor = nullptr;
 };
 
 
@@ -140,6 +316,7 @@ public:
 	tresult PLUGIN_API getState(IBStream* state) SMTG_OVERRIDE;
 
 	tresult PLUGIN_API canProcessSampleSize(int32 symbolicSampleSize) SMTG_OVERRIDE;
+	uint32 PLUGIN_API getTailSamples() SMTG_OVERRIDE;
 	tresult PLUGIN_API setActive(TBool state) SMTG_OVERRIDE;
 	tresult PLUGIN_API process(ProcessData& data) SMTG_OVERRIDE;
 	tresult PLUGIN_API processAudio(ProcessData& data);
@@ -147,6 +324,7 @@ public:
 	void strikingPositionChanged();
 	void resonatorTypeChanged();
 	void dimensionChanged();
+	void numModesChanged();
 
 	tresult PLUGIN_API notify(IMessage* message) SMTG_OVERRIDE;
 
@@ -156,13 +334,70 @@ public:
 protected:
 	VoiceProcessor* voiceProcessor;
 	GlobalParameterState paramState;
-	OneReaderOneWriter::RingBuffer<Event> controllerEvents{ 16 };
+	// Threads that help rendering the voices and the resonator: the pool shared by all instances, acquired
+	// in setActive() if the "Multi-Threading" parameter is on. Without it everything renders on the audio
+	// thread of the host. process() gives all the run()s of a call the length of its block as deadline.
+	WorkerPool* workerPool = nullptr;
+	ParallelFor parallelFor;
+	// Eigenfunctions that all voices are struck and listened to with, updated with the positions
+	VoiceModeShapes voiceModeShapes;
+	// Events from the UI keyboard. notify() is the only writer, process() the only reader. Every block
+	// takes the events that happened between the starts of the previous and the current block, both moved
+	// back by controllerEventLatency, and spreads them over its samples by their timestamps (so they are
+	// delayed by a constant block plus the latency). The first event that is too new waits in
+	// heldControllerEvent.
+	static constexpr int32 maxControllerEvents = 1024;
+	OneReaderOneWriter::RingBuffer<ControllerEvent> controllerEvents{ maxControllerEvents };
+	std::vector<Event> uiEvents; // events of the current block with their sampleOffset, reserved in setActive()
+	int64 previousBlockTime = 0;
+	ControllerEvent heldControllerEvent{};
+	bool hasHeldControllerEvent = false;
+	void popControllerEvents(int32 numSamples);
 
-	GlobalResonatorWrapper systemWrapper;
+	// Only the one matching processSetup.symbolicSampleSize is set up in setActive()
+	GlobalResonatorWrapper<Sample32> systemWrapper32;
+	GlobalResonatorWrapper<Sample64> systemWrapper64;
+	template<class SamplePrecision>
+	tresult processAudio(ProcessData& data, GlobalResonatorWrapper<SamplePrecision>& systemWrapper);
+	template<class SamplePrecision>
+	void setupResonator(GlobalResonatorWrapper<SamplePrecision>& systemWrapper);
+	template<class SamplePrecision>
+	void updateResonator(GlobalResonatorWrapper<SamplePrecision>& systemWrapper, uint32 flags);
+	// Set the decay of the resonator from paramState and publish its tail
+	template<class SamplePrecision>
+	void updateTailSamples(GlobalResonatorWrapper<SamplePrecision>& systemWrapper);
 
 	double vuPPM = 0;
 	double vuPPMOld = 0;
+	// Tail of the effect path, updated by updateTailSamples() and read by the host from any thread
+	std::atomic<uint32> tailSamples{ 0 };
 	int currDim = 10;
+
+	// Parameter changes and events are sample accurate: process() splits the block at every automation
+	// point and event and renders the pieces one after another. While a parameter ramps the block is also
+	// split every automationGranularity samples. splitPoints is reserved in setActive() for the block
+	// borders, the UI events, maxSplitPoints host events and automation points and the ramp grid of a
+	// full block. collectSplitPoints() keeps the events first and thins out the grid if space runs out.
+	static constexpr int32 automationGranularity = 32;
+	static constexpr int32 maxSplitPoints = 1024;
+	std::vector<int32> splitPoints;
+	void collectSplitPoints(ProcessData& data);
+	void applyParameterChanges(IParameterChanges* changes, int32 sampleOffset, int32 previousOffset);
+	void addSplitPoint(int32 sampleOffset);
+
+	// Derived state that processParameters() and setState() mark as outdated through the ...Changed()
+	// callbacks, setState() from another thread. process() brings it up to date once per sub-block,
+	// before rendering.
+	enum DirtyFlags : uint32
+	{
+		kStrikingPositionDirty = 1 << 0,
+		kListeningPositionDirty = 1 << 1,
+		kResonatorTypeDirty = 1 << 2,
+		kDimensionDirty = 1 << 3,
+		kNumModesDirty = 1 << 4,
+	};
+	std::atomic<uint32> dirtyFlags{ 0 };
+	void resolveDirtyState();
 };
 
 
@@ -0,0 +1,81 @@
+/*
+ * Benchmark of a decaying resonator tail
+ *
+ * A global cube with 256 modes and no amplitude floor (the worst case) is struck once and left to decay
+ * in blocks of 256 samples at 48 kHz, with the highpass of the effect path after it. The per-block cost
+ * is printed for every 400 blocks. From about block 2800 on, the tail is in the denormal range.
+ *
+ * Only the header-only resonator core is needed, not the SDK:
+ *
+ *     g++ -std=c++17 -O2 -I source source/tail_benchmark.cpp -o tail_benchmark
+ *
+ * or the tail_benchmark target with SYNTH1_BUILD_BENCHMARKS. Run it with --no-ftz to leave out the
+ * flush-to-zero guard of Processor::process(). Without denormals.h (trees before the amplitude floors)
+ * it always runs without the guard, which gives the numbers from before the floors.
+ */
+
+#include "eigen_evaluator.h"
+#include "filter.h"
+#if __has_include("denormals.h")
+#include "denormals.h"
+#define TAIL_BENCHMARK_FTZ
+#endif
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace VSTMath;
+using Steinberg::Vst::NoteExpressionSynth::Filter;
+
+int main(int argc, char** argv)
+{
+	const bool flushToZero = !(argc > 1 && std::strcmp(argv[1], "--no-ftz") == 0);
+	constexpr int numModes = 256;
+	constexpr int blockSize = 256;
+	constexpr int blocksPerRow = 400;
+	constexpr int rows = 12;
+
+	using Cube = CubeEigenvalueProblem<float, 10, 2>;
+	Cube cube{ 5 };
+	cube.setMaxModes(numModes);
+	std::vector<Vector<float, 11>> table(numModes);
+	Cube::computeModeTable(5, numModes, table.data());
+	cube.setModeTable(5, numModes, table.data());
+	cube.setSampleRate(48000);
+	cube.setVelocity_sq({ 2000, 2 });
+	cube.setStrikingPosition(Vector<float, 10>(.3f));
+	cube.setListeningPositions({ Vector<float, 10>(.7f), Vector<float, 10>(.2f) });
+
+	Filter filter{ Filter::kHighpass };
+	filter.setSampleRate(48000);
+	filter.setFreqAndQ(100, .8);
+
+	std::vector<float> in(blockSize, 0.f), left(blockSize), right(blockSize);
+	float* out[2] = { left.data(), right.data() };
+	in[0] = 1;
+	double sink = 0; // keeps the optimizer from dropping the work
+
+	std::printf("%s\n", flushToZero ? "with flush-to-zero" : "without flush-to-zero");
+	for (int row = 0; row < rows; ++row)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		for (int b = 0; b < blocksPerRow; ++b)
+		{
+#ifdef TAIL_BENCHMARK_FTZ
+			std::unique_ptr<ScopedFlushDenormals> guard;
+			if (flushToZero)
+				guard = std::make_unique<ScopedFlushDenormals>();
+#endif
+			cube.process(in.data(), out, blockSize);
+			in[0] = 0;
+			for (int i = 0; i < blockSize; ++i)
+				sink += filter.process(left[i]);
+		}
+		const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+		std::printf("blocks %5d-%5d: %7.2f us/block\n", row * blocksPerRow, (row + 1) * blocksPerRow, elapsed.count() / blocksPerRow);
+	}
+	std::printf("(%g)\n", sink);
+	return 0;
+}
@@ -37,12 +37,15 @@
 
 #include "ui.h"
 #include "vstgui/contrib/keyboardview.h"
+#include "vstgui/lib/cvstguitimer.h"
 #include "vstgui/plugin-bindings/vst3groupcontroller.h"
 #include "vstgui/plugin-bindings/vst3padcontroller.h"
 #include "base/source/fstreamer.h"
 #include "pluginterfaces/vst/ivstevents.h"
 #include "pluginterfaces/vst/ivstinterappaudio.h"
 #include "pluginterfaces/vst/ivstpluginterfacesupport.h"
+#include <algorithm>
+#include <array>
 #include <cassert>
 
 using namespace VSTGUI;
@@ -320,6 +323,14 @@ public:
 	VST3KeyboardPlayerDelegate (IConnectionPoint* _processor, NewMessageFunc&& _newMessage)
 	: newMessage (std::move (_newMessage)), processor (_processor)
 	{
+		flushTimer = makeOwned<CVSTGUITimer> ([this] (CVSTGUITimer*) { flushEvents (); },
+		                                      controllerEventFlushInterval, false);
+	}
+	~VST3KeyboardPlayerDelegate () noexcept
+	{
+		flushTimer->stop ();
+		// A note-off still waiting in the batch would leave its note hanging when the editor closes
+		flushEvents ();
 	}
 
 	int32_t onNoteOn (NoteIndex note, double /*xPos*/, double /*yPos*/) override
@@ -336,7 +347,7 @@ public:
 		evt.noteOn.velocity = 1.f;
 		evt.noteOn.length = 0;
 		evt.noteOn.noteId = newNoteID;
-		sendEvent (evt);
+		queueEvent (evt);
 		return newNoteID;
 	}
 
@@ -350,25 +361,46 @@ public:
 		evt.noteOff.velocity = 0.f;
 		evt.noteOff.noteId = noteID;
 		evt.noteOff.tuning = 0.f;
-		sendEvent (evt);
+		queueEvent (evt);
 	}
 
 	void onNoteModulation (int32_t /*noteID*/, double /*xPos*/, double /*yPos*/) override {}
 
 private:
-	void sendEvent (const Event& evt)
+	static constexpr int32 kMaxEventsPerMessage = 64;
+
+	// Stamp an event with the current time and send it with the others that come in until the flush
+	// timer fires, so that a glissando doesn't cost one message per key
+	void queueEvent (const Event& evt)
 	{
+		if (numPendingEvents == kMaxEventsPerMessage)
+			flushEvents ();
+		pendingEvents[numPendingEvents++] = {evt, controllerEventTime ()};
+		if (numPendingEvents == 1)
+			flushTimer->start ();
+	}
+
+	void flushEvents ()
+	{
+		flushTimer->stop ();
+		if (numPendingEvents == 0)
+			return;
 		if (auto message = owned (newMessage ()))
 		{
 			message->setMessageID (MsgIDEvent);
 			if (auto attr = message->getAttributes ())
 			{
-				attr->setBinary (MsgIDEvent, &evt, sizeof (Event));
+				attr->setBinary (MsgIDEvent, pendingEvents.data (),
+				                 numPendingEvents * sizeof (ControllerEvent));
 			}
 			processor->notify (message);
 		}
+		numPendingEvents = 0;
 	}
 
+	std::array<ControllerEvent, kMaxEventsPerMessage> pendingEvents;
+	int32 numPendingEvents = 0;
+	SharedPointer<CVSTGUITimer> flushTimer;
 	int32_t noteIDCounter = kNoteIDUserRangeUpperBound;
 	NewMessageFunc newMessage;
 	IConnectionPoint* processor {nullptr};
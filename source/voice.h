@@ -39,6 +39,8 @@
 #include "public.sdk/samples/vst/common/logscale.h"
 #include "brownnoise.h"
 #include "filter.h"
+#include "filter_bank.h"
+#include "mode_bank.h"
 #include "controller.h"
 #include "pluginterfaces/vst/ivstevents.h"
 #include "pluginterfaces/base/futils.h"
@@ -124,17 +126,67 @@ public:
 //-----------------------------------------------------------------------------
 //-----------------------------------------------------------------------------
 
-class PhysicalSystemWrapper {
+// Eigenfunctions of the voice resonators at the striking and listening positions. All voices share the
+// positions X and Y of the GlobalParameterState, so the Processor evaluates them once whenever these
+// change and a note on only copies them.
+class VoiceModeShapes {
 public:
 
 	using type = float;
-	VSTMath::Vector<type, maxDimension> strikePosition{};
-	VSTMath::Vector<type, maxDimension> listenerPosition{};
+	// Voices are cheap, many of them may be playing at once
+	static constexpr int numModes = 5;
+
+	VoiceModeShapes() {
+		system.setMaxModes(numModes);
+		system.setNumModes(numModes);
+	}
+
+	// Positions are normalized like GlobalParameterState::X and Y
+	void setStrikingPosition(const std::array<ParamValue, maxDimension>& X) {
+		system.setStrikingPosition(toSpherical(X));
+	}
+	void setListeningPosition(const std::array<ParamValue, maxDimension>& Y) {
+		system.setFirstListeningPosition(toSpherical(Y));
+	}
+
+	const type* getStrikingEvaluations() const { return system.getStrikingEvaluations(); }
+	const type* getListeningEvaluations() const { return system.getListeningEvaluations(0); }
+
+private:
+	static VSTMath::Vector<type, 3> toSpherical(const std::array<ParamValue, maxDimension>& pos) {
+		constexpr type twopi = 2 * VSTMath::pi<type>();
+		return { (type)pos[0], twopi * (type)pos[1], twopi * (type)pos[2] };
+	}
+
+	// Only evaluates the eigenfunctions, its modes never ring
+	VSTMath::SphereEigenvalueProblem<type, 3, 1> system;
+};
+
+
+class PhysicalSystemWrapper {
+public:
 
-	VSTMath::SphereEigenvalueProblem<type, 3, 5, 1> system;
+	using type = VoiceModeShapes::type;
+
+	static constexpr int numModes = VoiceModeShapes::numModes;
+	// The system only provides the modes, they ring in a lane of a bank shared by all voices
+	VSTMath::SphereEigenvalueProblem<type, 3, 1> system;
+	using ModeBank = VoiceModeBank<type, MAX_VOICES, numModes>;
 
 	type strikeAmount = 1.f;
-	//VSTMath::CubeEigenvalueProblem<float, 4, 5, 1> system;
+	//VSTMath::CubeEigenvalueProblem<float, 4, 1> system;
+
+	PhysicalSystemWrapper() {
+		system.setMaxModes(numModes);
+		system.setNumModes(numModes);
+	}
+
+	void setModeBank(ModeBank* bank, int32 lane) {
+		modeBank = bank;
+		modeLane = lane;
+		modeBank->setAmplitudeFloor(amplitudeFloor);
+		modeBank->silence(modeLane);
+	}
 
 
 	int32 samplesFromNoteOn = 0;
@@ -144,7 +196,9 @@ public:
 	ParamValue attackRamp = 1;
 
 	void reset() {
-		system.silence();
+		if (modeBank)
+			modeBank->silence(modeLane);
+		renderPos = 0;
 		noteoffFlag = false;
 	}
 
@@ -165,12 +219,8 @@ public:
 		system.resetTime(); // let's avoid a discontinuity at beginning
 		system.setVelocity_sq({ VoiceStatics::freqTab[_pitch],std::max((float)gps->decay * 5.f,0.f) });
 
-		const auto& pos_lis = listenerPosition;
-		const auto& pos_str = strikePosition;
-		constexpr type twopi = 2 * VSTMath::pi<type>();
-		system.setFirstListeningPosition({ pos_lis[0],twopi * pos_lis[1],twopi * pos_lis[2] });
-		system.setStrikingPosition({ pos_str[0],twopi * pos_str[1],twopi * pos_str[2] });
-		system.pinchDelta(strikeAmount);
+		const VoiceModeShapes& shapes = *gps->voiceModeShapes;
+		modeBank->strike(modeLane, system, shapes.getListeningEvaluations(), shapes.getStrikingEvaluations(), strikeAmount);
 	}
 
 	void noteOff(ParamValue velocity, int32 sampleOffset) {
@@ -178,9 +228,24 @@ public:
 		noteoffFlag = true;
 	}
 
+	// True once the resonator has rung out. The threshold is lower than the one of the global resonator
+	// because the voice output is amplified.
+	bool isSilent() {
+		return modeBank->getEnergy(modeLane) < silenceThreshold * silenceThreshold;
+	}
+
 	// Called when release time has elapsed
 	void noteFinished() {
-		system.silence();
+		modeBank->silence(modeLane);
+	}
+
+	// Called before the samples of a block are read with nextFirstChannel(), after the bank rendered them
+	void startBlock() {
+		renderPos = 0;
+	}
+	// Render the lane of this voice on its own, for voices that are processed one after the other
+	void renderLane(int32 numSamples) {
+		modeBank->processLane(modeLane, numSamples);
 	}
 
 	type nextFirstChannel() {
@@ -194,12 +259,19 @@ public:
 			if (std::abs(sample) < 0.0001) {
 			}
 		}*/
-		return  currentADSRVolume * system.nextFirstChannel();
+		return  currentADSRVolume * modeBank->getOutput(renderPos++, modeLane);
 	}
 
 private:
 
 	bool noteoffFlag = false;
+
+	static constexpr type amplitudeFloor = 1e-6f;
+	static constexpr type silenceThreshold = 1e-6f;
+	ModeBank* modeBank = nullptr;
+	int32 modeLane = 0;
+	// Position in the block last rendered by the bank
+	int32 renderPos = 0;
 };
 
 //-----------------------------------------------------------------------------
@@ -223,6 +295,21 @@ public:
 	bool process(SamplePrecision* outputBuffers[2], int32 numSamples);
 	void reset() SMTG_OVERRIDE;
 
+	// The filter and the resonator of a voice are lanes of banks shared by all voices
+	using FilterBank = VoiceFilterBank<MAX_VOICES>;
+	using ModeBank = PhysicalSystemWrapper::ModeBank;
+	static_assert(FilterBank::blockSize == ModeBank::blockSize, "the banks need to process the same blocks");
+	void setFilterBank(FilterBank* bank, int32 lane);
+	void setModeBank(ModeBank* bank, int32 lane);
+
+	// process() in steps, so that the resonators and filters of all voices can run in between: after the
+	// resonator of the voice has been rendered by the bank, renderDry() writes the unfiltered signal to
+	// dry[i * stride] and the gains of both channels to gains[0/1][i * stride] and asks the bank for the
+	// filter ramps. It returns false when the voice has finished, the rest of the block is silent then.
+	// mix() adds the filtered signal to the outputs. numSamples is at most FilterBank::blockSize.
+	bool renderDry(double* dry, int32 stride, ParamValue* const gains[2], int32 numSamples);
+	void mix(SamplePrecision* outputBuffers[2], const double* filtered, int32 stride, const ParamValue* const gains[2], int32 numSamples);
+
 	void setNoteExpressionValue(int32 index, ParamValue value) SMTG_OVERRIDE;
 
 protected:
@@ -230,7 +317,8 @@ protected:
 	int32 noisePos;
 	int32 noiseStep;
 
-	Filter* filter;
+	FilterBank* filterBank = nullptr;
+	int32 filterLane = 0;
 
 	//SamplePrecision trianglePhase;
 	//SamplePrecision sinusPhase;
@@ -372,7 +460,7 @@ void Voice<SamplePrecision>::setNoteExpressionValue(int32 index, ParamValue valu
 	//------------------------------
 	case Controller::kFilterTypeTypeID:
 	{
-		filter->setType((Filter::Type)std::min<int32>((int32)(NUM_FILTER_TYPE * value), NUM_FILTER_TYPE - 1));
+		filterBank->setType(filterLane, (Filter::Type)std::min<int32>((int32)(NUM_FILTER_TYPE * value), NUM_FILTER_TYPE - 1));
 		break;
 	}
 	//------------------------------
@@ -393,6 +481,40 @@ void Voice<SamplePrecision>::setNoteExpressionValue(int32 index, ParamValue valu
 //-----------------------------------------------------------------------------
 template<class SamplePrecision>
 bool Voice<SamplePrecision>::process(SamplePrecision* outputBuffers[2], int32 numSamples)
+{
+	double dry[FilterBank::blockSize];
+	ParamValue gainL[FilterBank::blockSize];
+	ParamValue gainR[FilterBank::blockSize];
+	ParamValue* gains[2] = { gainL, gainR };
+	for (int32 start = 0; start < numSamples; start += FilterBank::blockSize)
+	{
+		int32 blockSamples = std::min<int32>(FilterBank::blockSize, numSamples - start);
+		systemWrapper.renderLane(blockSamples);
+		bool playing = renderDry(dry, 1, gains, blockSamples);
+		filterBank->processLane(filterLane, dry, blockSamples);
+		SamplePrecision* blockOutputs[2] = { outputBuffers[0] + start, outputBuffers[1] + start };
+		mix(blockOutputs, dry, 1, gains, blockSamples);
+		if (!playing)
+			return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+template<class SamplePrecision>
+void Voice<SamplePrecision>::mix(SamplePrecision* outputBuffers[2], const double* filtered, int32 stride, const ParamValue* const gains[2], int32 numSamples)
+{
+	for (int32 i = 0; i < numSamples; i++)
+	{
+		SamplePrecision sample = (SamplePrecision)filtered[i * stride];
+		outputBuffers[0][i] += (SamplePrecision)(sample * gains[0][i * stride]);
+		outputBuffers[1][i] += (SamplePrecision)(sample * gains[1][i * stride]);
+	}
+}
+
+//-----------------------------------------------------------------------------
+template<class SamplePrecision>
+bool Voice<SamplePrecision>::renderDry(double* dry, int32 stride, ParamValue* const gains[2], int32 numSamples)
 {
 	//---compute tuning-------------------------
 
@@ -403,6 +525,8 @@ bool Voice<SamplePrecision>::process(SamplePrecision* outputBuffers[2], int32 nu
 		tuningInHz = VoiceStatics::freqTab[this->pitch] * (::pow(2.0, (this->values[kTuningMod] * 10 + this->globalParameters->masterTuning * 2.0 / 12.0 + this->tuning)) - 1);
 	}
 
+	systemWrapper.startBlock();
+
 	//ParamValue triangleFreq = (VoiceStatics::freqTab[this->pitch] + tuningInHz) * M_PI_MUL_2 / this->getSampleRate() / 2.;
 	//if (currentTriangleF == -1)
 	//	currentTriangleF = triangleFreq;
@@ -466,11 +590,30 @@ bool Voice<SamplePrecision>::process(SamplePrecision* outputBuffers[2], int32 nu
 		filterQRamp = (wantedLPQ - currentLPQ) / rampTime;
 	}
 
+	// the filter follows the ramps from the sample on which the voice sounds: the bank gets the targets of
+	// the sub-blocks of FilterBank::updateInterval samples here and moves the coefficients there linearly
+	if (filterFreqRamp != 0. || filterQRamp != 0.)
+	{
+		const int32 rampBegin = std::min<int32>(numSamples, std::max<int32>(0, this->noteOnSampleOffset - 1));
+		const int32 firstSubBlock = (rampBegin + FilterBank::updateInterval - 1) / FilterBank::updateInterval;
+		for (int32 start = firstSubBlock * FilterBank::updateInterval; start < numSamples; start += FilterBank::updateInterval)
+		{
+			const ParamValue rampSamples = start - rampBegin + FilterBank::updateInterval;
+			ParamValue targetFreq = Bound(0., 1., currentLPFreq + filterFreqRamp * rampSamples);
+			ParamValue targetQ = Bound(0., 1., currentLPQ + filterQRamp * rampSamples);
+			filterBank->rampFreqAndQ(filterLane, start / FilterBank::updateInterval, VoiceStatics::freqLogScale.scale(targetFreq), 1. - targetQ);
+		}
+		currentLPFreq += filterFreqRamp * (numSamples - rampBegin);
+		currentLPQ += filterQRamp * (numSamples - rampBegin);
+	}
+
 
 	for (int32 i = 0; i < numSamples; i++)
 	{
 		this->noteOnSampleOffset--;
 		this->noteOffSampleOffset--;
+		dry[i * stride] = 0.;
+		gains[0][i * stride] = gains[1][i * stride] = 0.;
 
 		if (this->noteOnSampleOffset <= 0)
 		{
@@ -478,7 +621,7 @@ bool Voice<SamplePrecision>::process(SamplePrecision* outputBuffers[2], int32 nu
 			if (this->noteOffSampleOffset == 0)
 			{
 				volumeRamp = 0;
-				if (currentVolume > 0)
+				if (currentVolume > 0 && !systemWrapper.isSilent())
 				{
 					// ramp note off
 					currentVolume -= noteOffVolumeRamp;
@@ -491,6 +634,11 @@ bool Voice<SamplePrecision>::process(SamplePrecision* outputBuffers[2], int32 nu
 					this->noteOffSampleOffset = this->noteOnSampleOffset = -1;
 					// tone is finished
 					systemWrapper.noteFinished();
+					for (; i < numSamples; i++)
+					{
+						dry[i * stride] = 0.;
+						gains[0][i * stride] = gains[1][i * stride] = 0.;
+					}
 					return false;
 				}
 			}
@@ -514,18 +662,10 @@ bool Voice<SamplePrecision>::process(SamplePrecision* outputBuffers[2], int32 nu
 			// add noise
 			//sample += (SamplePrecision)(this->globalParameters->noiseBuffer->at(noisePos) * currentNoiseVolume);
 
-			// filter
-			if (filterFreqRamp != 0. || filterQRamp != 0.)
-			{
-				filter->setFreqAndQ(VoiceStatics::freqLogScale.scale(currentLPFreq), 1. - currentLPQ);
-				currentLPFreq += filterFreqRamp;
-				currentLPQ += filterQRamp;
-			}
-			sample = (SamplePrecision)filter->process(sample);
-
-			// store in output
-			outputBuffers[0][i] += (SamplePrecision)(sample * currentPanningLeft * currentVolume);
-			outputBuffers[1][i] += (SamplePrecision)(sample * currentPanningRight * currentVolume);
+			// store for filtering and mixing
+			dry[i * stride] = sample;
+			gains[0][i * stride] = currentPanningLeft * currentVolume;
+			gains[1][i * stride] = currentPanningRight * currentVolume;
 
 			//// advance noise
 			//noisePos += noiseStep;
@@ -565,19 +705,14 @@ void Voice<SamplePrecision>::noteOn(int32 _pitch, ParamValue velocity, float _tu
 	currentPhiStrike = this->values[kPhiStrike] = this->globalParameters->phiStrike;
 	currentPhiListening = this->values[kPhiListening] = this->globalParameters->phiListening;
 
-
-	for (int i = 0; i < maxDimension; i++) {
-		systemWrapper.strikePosition[i] = this->globalParameters->X[i];
-		systemWrapper.listenerPosition[i] = this->globalParameters->Y[i];
-	}
 	// filter setting
 	currentLPFreq = this->globalParameters->filterFreq;
 	this->values[kFilterFrequencyMod] = 0;
 	currentLPQ = this->globalParameters->filterQ;
 	this->values[kFilterQMod] = 0;
 
-	filter->setType((Filter::Type)this->globalParameters->filterType);
-	filter->setFreqAndQ(VoiceStatics::freqLogScale.scale(currentLPFreq), 1. - currentLPQ);
+	filterBank->setType(filterLane, (Filter::Type)this->globalParameters->filterType);
+	filterBank->setFreqAndQ(filterLane, VoiceStatics::freqLogScale.scale(currentLPFreq), 1. - currentLPQ);
 
 	//currentSinusDetune = 0.;
 	//if (this->globalParameters->sinusDetune != 0.)
@@ -639,7 +774,8 @@ void Voice<SamplePrecision>::reset()
 
 	currentLPFreq = 1.;
 	currentLPQ = 0.;
-	filter->reset();
+	if (filterBank)
+		filterBank->reset(filterLane);
 	noteOffVolumeRamp = 0.005;
 
 	systemWrapper.reset();
@@ -651,7 +787,6 @@ void Voice<SamplePrecision>::reset()
 template<class SamplePrecision>
 void Voice<SamplePrecision>::setSampleRate(ParamValue _sampleRate)
 {
-	filter->setSampleRate(_sampleRate);
 	VoiceBase<kNumParameters, SamplePrecision, 2, GlobalParameterState>::setSampleRate(_sampleRate);
 
 	//set sample rate of string
@@ -662,14 +797,28 @@ void Voice<SamplePrecision>::setSampleRate(ParamValue _sampleRate)
 template<class SamplePrecision>
 Voice<SamplePrecision>::Voice()
 {
-	filter = new Filter(Filter::kLowpass);
 }
 
 //-----------------------------------------------------------------------------
 template<class SamplePrecision>
 Voice<SamplePrecision>::~Voice()
 {
-	delete filter;
+}
+
+//-----------------------------------------------------------------------------
+template<class SamplePrecision>
+void Voice<SamplePrecision>::setFilterBank(FilterBank* bank, int32 lane)
+{
+	filterBank = bank;
+	filterLane = lane;
+	filterBank->reset(filterLane);
+}
+
+//-----------------------------------------------------------------------------
+template<class SamplePrecision>
+void Voice<SamplePrecision>::setModeBank(ModeBank* bank, int32 lane)
+{
+	systemWrapper.setModeBank(bank, lane);
 }
 
 }
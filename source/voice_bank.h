@@ -0,0 +1,210 @@
+#pragma once
+
+
+/*
+ * Voice processor that renders all voices together
+ *
+ * VoiceProcessorImplementation runs one voice after the other. VoiceBankProcessor splits the work of the
+ * voices into steps and runs each step for all voices before the next one, so that the steps can work on
+ * all voices at once:
+ *
+ *  1. the resonators of all voices ring in a VoiceModeBank,
+ *  2. each voice turns its resonator output into the dry signal and the gains of both channels,
+ *  3. the filters of all voices run in a VoiceFilterBank,
+ *  4. the filtered signals are multiplied by the gains and summed up across the voices.
+ *
+ * Signals and gains of all voices are interleaved by voice, so steps 1, 3 and 4 process
+ * SimdVector::width voices per instruction. Only the voices themselves (step 2) are still called one by one.
+ *
+ * Steps 1 to 3 only touch the lanes of their own voices. They run per group of taskLanes voices, and with
+ * a WorkerPool the groups are spread over its threads. The mixdown (step 4) always runs on the calling
+ * thread in the same order, so the output doesn't depend on which thread rendered which voices. The
+ * sub-blocks of a process() call share the time budget of the ParallelFor, once it is used up the
+ * calling thread renders the rest of the groups itself.
+ *
+ * Events are handed over by the Processor with processEvent() between sub-blocks. Blocks that still come
+ * with events are left to VoiceProcessorImplementation. Like the base with clearOutputNeeded(false), the
+ * voices are added to the outputs.
+ */
+
+
+#ifndef __VOICE_BANK_H__
+#define __VOICE_BANK_H__
+
+#include "public.sdk/samples/vst/common/voiceprocessor.h"
+#include "voice.h"
+#include "worker_pool.h"
+
+
+namespace Steinberg {
+namespace Vst {
+namespace NoteExpressionSynth {
+
+
+template<class SamplePrecision>
+class VoiceBankProcessor : public VoiceProcessorImplementation<SamplePrecision, Voice<SamplePrecision>, 2, MAX_VOICES, GlobalParameterState>
+{
+public:
+	using Base = VoiceProcessorImplementation<SamplePrecision, Voice<SamplePrecision>, 2, MAX_VOICES, GlobalParameterState>;
+	using FilterBank = typename Voice<SamplePrecision>::FilterBank;
+	using ModeBank = typename Voice<SamplePrecision>::ModeBank;
+	static constexpr int32 blockSize = FilterBank::blockSize;
+	// Number of voices per task, a multiple of the SIMD widths of both banks
+	static constexpr int32 taskLanes = 8;
+	static_assert(taskLanes % ModeBank::V::width == 0 && taskLanes % FilterBank::V::width == 0, "tasks need to be aligned to the SIMD width");
+
+	// parallelFor may be nullptr, then all voices are rendered on the calling thread
+	VoiceBankProcessor(float sampleRate, GlobalParameterState* globalParameters, const ParallelFor* parallelFor = nullptr)
+		: Base(sampleRate, globalParameters), parallelFor(parallelFor)
+	{
+		filterBank.setSampleRate(sampleRate);
+		dry.resize(blockSize * MAX_VOICES);
+		for (auto& gain : gainBuffers)
+			gain.resize(blockSize * MAX_VOICES);
+		for (int32 v = 0; v < MAX_VOICES; ++v)
+		{
+			this->voices[v].setFilterBank(&filterBank, v);
+			this->voices[v].setModeBank(&modeBank, v);
+			gains[v][0] = gainBuffers[0].data() + v;
+			gains[v][1] = gainBuffers[1].data() + v;
+		}
+	}
+
+	tresult process(ProcessData& data) SMTG_OVERRIDE
+	{
+		if (data.inputEvents && data.inputEvents->getEventCount() > 0)
+			return Base::process(data);
+		if (this->activeVoices == 0)
+			return kResultTrue;
+
+		void** channels = sizeof(SamplePrecision) == sizeof(Sample32) ? (void**)data.outputs[0].channelBuffers32 : (void**)data.outputs[0].channelBuffers64;
+		for (int32 start = 0; start < data.numSamples; start += blockSize)
+		{
+			SamplePrecision* outputs[2] = { (SamplePrecision*)channels[0] + start, (SamplePrecision*)channels[1] + start };
+			renderBlock(outputs, std::min<int32>(blockSize, data.numSamples - start));
+		}
+		return kResultTrue;
+	}
+
+protected:
+	void renderBlock(SamplePrecision* outputs[2], int32 numSamples)
+	{
+		numTasks = 0;
+		for (int32 group = 0; group < MAX_VOICES; group += taskLanes)
+		{
+			bool any = false;
+			for (int32 v = group; v < group + taskLanes; ++v)
+			{
+				active[v] = this->voices[v].getNoteId() != -1;
+				any |= active[v];
+			}
+			if (any)
+				tasks[numTasks++] = group;
+		}
+
+		taskSamples = numSamples;
+		if (parallelFor)
+		{
+			(*parallelFor)(numTasks, &VoiceBankProcessor::renderTask, this);
+		}
+		else
+		{
+			for (int32 k = 0; k < numTasks; ++k)
+				renderGroup(tasks[k], numSamples);
+		}
+
+		mixdown(outputs, numSamples);
+		finishBlock();
+	}
+
+	// Free the voices that have stopped playing in the last block
+	void finishBlock()
+	{
+		for (int32 v = 0; v < MAX_VOICES; ++v)
+		{
+			if (active[v] && !playing[v])
+			{
+				this->voices[v].reset();
+				this->activeVoices--;
+			}
+		}
+	}
+
+	static void renderTask(void* context, int task)
+	{
+		auto* self = static_cast<VoiceBankProcessor*>(context);
+		self->renderGroup(self->tasks[task], self->taskSamples);
+	}
+
+	// Steps 1 to 3 for the voices [group, group + taskLanes)
+	void renderGroup(int32 group, int32 numSamples)
+	{
+		const int32 end = group + taskLanes;
+		modeBank.process(numSamples, active, group, end);
+
+		for (int32 v = group; v < end; ++v)
+		{
+			if (active[v])
+			{
+				playing[v] = this->voices[v].renderDry(dry.data() + v, MAX_VOICES, gains[v], numSamples);
+			}
+			else
+			{
+				for (int32 i = 0; i < numSamples; ++i)
+					dry[i * MAX_VOICES + v] = gainBuffers[0][i * MAX_VOICES + v] = gainBuffers[1][i * MAX_VOICES + v] = 0.;
+			}
+		}
+
+		filterBank.process(dry.data(), numSamples, active, group, end);
+	}
+
+	// Add the filtered signals times the gains of all voices to the outputs. Groups of voices in which none
+	// is active are skipped, the others are silent in the inactive voices.
+	void mixdown(SamplePrecision* outputs[2], int32 numSamples)
+	{
+		using V = VSTMath::SimdVector<double>;
+		int32 groups[MAX_VOICES / V::width];
+		int32 numGroups = 0;
+		for (int32 group = 0; group < MAX_VOICES; group += V::width)
+		{
+			if (std::any_of(active + group, active + group + V::width, [](bool a) { return a; }))
+				groups[numGroups++] = group;
+		}
+
+		for (int32 i = 0; i < numSamples; ++i)
+		{
+			const int32 offset = i * MAX_VOICES;
+			V left = V::broadcast(0.);
+			V right = V::broadcast(0.);
+			for (int32 k = 0; k < numGroups; ++k)
+			{
+				const V filtered = V::load(dry.data() + offset + groups[k]);
+				left = left + filtered * V::load(gainBuffers[0].data() + offset + groups[k]);
+				right = right + filtered * V::load(gainBuffers[1].data() + offset + groups[k]);
+			}
+			outputs[0][i] += (SamplePrecision)left.sum();
+			outputs[1][i] += (SamplePrecision)right.sum();
+		}
+	}
+
+	ModeBank modeBank;
+	FilterBank filterBank;
+	// Dry and filtered signal of all voices, interleaved by voice
+	VSTMath::AlignedBuffer<double> dry;
+	// Gains of both channels of all voices, interleaved by voice. gains[v] points to the ones of voice v.
+	std::array<VSTMath::AlignedBuffer<ParamValue>, 2> gainBuffers;
+	ParamValue* gains[MAX_VOICES][2];
+	bool active[MAX_VOICES] = {};
+	bool playing[MAX_VOICES] = {};
+
+	const ParallelFor* parallelFor;
+	// First voices of the groups with active voices in the current block
+	int32 tasks[MAX_VOICES / taskLanes];
+	int32 numTasks = 0;
+	int32 taskSamples = 0;
+};
+
+}
+}
+} // namespaces
+#endif
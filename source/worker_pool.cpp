@@ -0,0 +1,412 @@
+#include "worker_pool.h"
+#include "denormals.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <avrt.h>
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#include <pthread.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#endif
+
+
+namespace Steinberg {
+namespace Vst {
+namespace NoteExpressionSynth {
+
+namespace {
+
+// How long idle workers spin before they park. Long enough for the next run() of the same block, between
+// the blocks of the host they are parked.
+constexpr std::chrono::microseconds spinTime{ 200 };
+// SCHED_FIFO priority of the workers on Linux, below the audio threads of JACK and most hosts
+constexpr int linuxRealtimePriority = 50;
+
+// Number of pools with workers in the process, their workers are only pinned while there is just one
+std::atomic<int> activePools{ 0 };
+
+// The pool of acquireShared() and the number of instances using it
+std::mutex sharedMutex;
+int sharedUsers = 0;
+WorkerPool& sharedPool()
+{
+	static WorkerPool pool;
+	return pool;
+}
+
+inline void cpuRelax()
+{
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+	_mm_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+// Real-time priority for the calling thread for as long as it lives: SCHED_FIFO on Linux, the "Pro Audio"
+// task of MMCSS on Windows and the time constraint policy on macOS. Plugins can't join the audio workgroup
+// of the host through VST3, so the time constraint policy is the best we get there. Without the rights
+// (e.g. no rtprio limit on Linux) the thread simply keeps its normal priority.
+class ScopedRealtimePriority
+{
+public:
+	explicit ScopedRealtimePriority(std::chrono::nanoseconds period)
+	{
+#if defined(_WIN32)
+		(void)period;
+		DWORD taskIndex = 0;
+		task = AvSetMmThreadCharacteristicsW(L"Pro Audio", &taskIndex);
+		if (task)
+			AvSetMmThreadPriority(task, AVRT_PRIORITY_HIGH);
+		else
+			SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+#elif defined(__APPLE__)
+		mach_timebase_info_data_t timebase;
+		mach_timebase_info(&timebase);
+		const double ticksPerNanosecond = static_cast<double>(timebase.denom) / timebase.numer;
+		thread_time_constraint_policy_data_t policy;
+		policy.period = static_cast<uint32_t>(period.count() * ticksPerNanosecond);
+		policy.computation = policy.period / 2;
+		policy.constraint = policy.period;
+		policy.preemptible = true;
+		thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY,
+			reinterpret_cast<thread_policy_t>(&policy), THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+#elif defined(__linux__)
+		(void)period;
+		pthread_getschedparam(pthread_self(), &previousPolicy, &previousParam);
+		sched_param param = {};
+		param.sched_priority = std::clamp(linuxRealtimePriority, sched_get_priority_min(SCHED_FIFO), sched_get_priority_max(SCHED_FIFO));
+		changed = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#else
+		(void)period;
+#endif
+	}
+	~ScopedRealtimePriority()
+	{
+#if defined(_WIN32)
+		if (task)
+			AvRevertMmThreadCharacteristics(task);
+#elif defined(__linux__)
+		if (changed)
+			pthread_setschedparam(pthread_self(), previousPolicy, &previousParam);
+#endif
+	}
+
+	ScopedRealtimePriority(const ScopedRealtimePriority&) = delete;
+	ScopedRealtimePriority& operator=(const ScopedRealtimePriority&) = delete;
+
+private:
+#if defined(_WIN32)
+	HANDLE task = nullptr;
+#elif defined(__linux__)
+	int previousPolicy = SCHED_OTHER;
+	sched_param previousParam = {};
+	bool changed = false;
+#endif
+};
+
+// Keeps the calling thread on one core or lets it run anywhere again. On macOS this is only a hint: threads
+// with different tags are spread over different cores.
+class ThreadAffinity
+{
+public:
+	ThreadAffinity()
+	{
+#if defined(__linux__)
+		CPU_ZERO(&original);
+		pthread_getaffinity_np(pthread_self(), sizeof(original), &original);
+#endif
+	}
+
+	void update(int core, bool pin)
+	{
+		if (pin == pinned)
+			return;
+		pinned = pin;
+#if defined(_WIN32)
+		if (pin && core < static_cast<int>(sizeof(DWORD_PTR) * 8))
+			original = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core);
+		else if (!pin && original)
+			SetThreadAffinityMask(GetCurrentThread(), original);
+#elif defined(__APPLE__)
+		thread_affinity_policy_data_t policy = { pin ? core + 1 : THREAD_AFFINITY_TAG_NULL };
+		thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_AFFINITY_POLICY,
+			reinterpret_cast<thread_policy_t>(&policy), THREAD_AFFINITY_POLICY_COUNT);
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(core, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), pin ? &set : &original);
+#else
+		(void)core;
+#endif
+	}
+
+private:
+	bool pinned = false;
+#if defined(_WIN32)
+	DWORD_PTR original = 0;
+#elif defined(__linux__)
+	cpu_set_t original;
+#endif
+};
+
+}
+
+// None of the systems takes a lock in user space to post
+class WorkerPool::Semaphore
+{
+public:
+#if defined(_WIN32)
+	Semaphore() : handle(CreateSemaphoreW(nullptr, 0, MAXLONG, nullptr)) {}
+	~Semaphore() { CloseHandle(handle); }
+	void post(int count) { ReleaseSemaphore(handle, count, nullptr); }
+	void wait() { WaitForSingleObject(handle, INFINITE); }
+
+private:
+	HANDLE handle;
+#elif defined(__APPLE__)
+	Semaphore() : semaphore(dispatch_semaphore_create(0)) {}
+	~Semaphore() { dispatch_release(semaphore); }
+	void post(int count)
+	{
+		for (int i = 0; i < count; ++i)
+			dispatch_semaphore_signal(semaphore);
+	}
+	void wait() { dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER); }
+
+private:
+	dispatch_semaphore_t semaphore;
+#else
+	Semaphore() { sem_init(&semaphore, 0, 0); }
+	~Semaphore() { sem_destroy(&semaphore); }
+	void post(int count)
+	{
+		for (int i = 0; i < count; ++i)
+			sem_post(&semaphore);
+	}
+	void wait()
+	{
+		while (sem_wait(&semaphore) != 0)
+			; // interrupted by a signal
+	}
+
+private:
+	sem_t semaphore;
+#endif
+};
+
+//-----------------------------------------------------------------------------
+WorkerPool::WorkerPool() = default;
+
+//-----------------------------------------------------------------------------
+WorkerPool::~WorkerPool()
+{
+	stop();
+}
+
+//-----------------------------------------------------------------------------
+void WorkerPool::start(int numWorkers, std::chrono::nanoseconds period)
+{
+	stop();
+	const int cores = static_cast<int>(std::thread::hardware_concurrency());
+	numWorkers = std::clamp(std::min(numWorkers, cores - 1), 0, maxWorkers);
+	numThreads = numWorkers + 1;
+	if (numWorkers > 0)
+		activePools.fetch_add(1);
+	parking = std::make_unique<Semaphore>();
+	parked.store(0);
+	running.store(true);
+	workers.reserve(numWorkers);
+	for (int i = 0; i < numWorkers; ++i)
+		workers.emplace_back([this, i, period] { workerLoop(i + 1, period); });
+}
+
+//-----------------------------------------------------------------------------
+void WorkerPool::stop()
+{
+	running.store(false);
+	wakeParked();
+	for (auto& worker : workers)
+		worker.join();
+	if (!workers.empty())
+		activePools.fetch_sub(1);
+	workers.clear();
+	numThreads = 1;
+}
+
+//-----------------------------------------------------------------------------
+WorkerPool* WorkerPool::acquireShared(std::chrono::nanoseconds period)
+{
+	std::lock_guard<std::mutex> lock(sharedMutex);
+	if (sharedUsers++ == 0)
+		sharedPool().start(maxWorkers, period);
+	return &sharedPool();
+}
+
+//-----------------------------------------------------------------------------
+void WorkerPool::releaseShared()
+{
+	std::lock_guard<std::mutex> lock(sharedMutex);
+	if (sharedUsers > 0 && --sharedUsers == 0)
+		sharedPool().stop();
+}
+
+//-----------------------------------------------------------------------------
+void WorkerPool::run(int numTasks, Task task, void* context, Clock::time_point deadline)
+{
+	if (workers.empty() || numTasks <= 1 || Clock::now() >= deadline || inUse.exchange(true, std::memory_order_acquire))
+	{
+		for (int i = 0; i < numTasks; ++i)
+			task(context, i);
+		return;
+	}
+
+	this->task = task;
+	this->context = context;
+	deadlineTicks.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+	remaining.store(numTasks, std::memory_order_relaxed);
+	const uint32_t current = generation.load(std::memory_order_relaxed) + 1;
+	for (int s = 0; s < numThreads; ++s)
+	{
+		const uint64_t begin = static_cast<uint64_t>(numTasks) * s / numThreads;
+		const uint64_t end = static_cast<uint64_t>(numTasks) * (s + 1) / numThreads;
+		slices[s].state.store(static_cast<uint64_t>(current) << 32 | end << 16 | begin, std::memory_order_relaxed);
+	}
+	// Spinning workers see the new generation, parked ones need the semaphore. Both sides order their
+	// accesses of generation and parked sequentially consistent, so a worker that is about to park either
+	// still sees the new generation or gets counted here.
+	generation.store(current);
+	if (parked.load() > 0)
+		wakeParked();
+
+	work(0, current);
+	// Everything that is left has been started by a worker which is still at it
+	while (remaining.load(std::memory_order_acquire) > 0)
+	{
+		for (int i = 0; i < 64; ++i)
+			cpuRelax();
+	}
+	inUse.store(false, std::memory_order_release);
+}
+
+//-----------------------------------------------------------------------------
+void WorkerPool::wakeParked()
+{
+	const int count = parked.exchange(0);
+	if (count > 0)
+		parking->post(count);
+}
+
+//-----------------------------------------------------------------------------
+bool WorkerPool::unpark()
+{
+	int count = parked.load();
+	while (count > 0)
+	{
+		if (parked.compare_exchange_weak(count, count - 1))
+			return true;
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+void WorkerPool::work(int self, uint32_t current)
+{
+	for (int k = 0; k < numThreads; ++k)
+	{
+		Slice& slice = slices[(self + k) % numThreads];
+		int index;
+		// Past the deadline the calling thread (self 0) does the rest
+		while ((self == 0 || !pastDeadline()) && claim(slice, current, index))
+		{
+			task(context, index);
+			remaining.fetch_sub(1, std::memory_order_release);
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+bool WorkerPool::pastDeadline() const
+{
+	return Clock::now().time_since_epoch().count() >= deadlineTicks.load(std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------
+bool WorkerPool::claim(Slice& slice, uint32_t current, int& index)
+{
+	uint64_t state = slice.state.load(std::memory_order_acquire);
+	for (;;)
+	{
+		const int end = static_cast<int>(state >> 16 & 0xffff);
+		const int next = static_cast<int>(state & 0xffff);
+		if (static_cast<uint32_t>(state >> 32) != current || next >= end)
+			return false;
+		if (slice.state.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			index = next;
+			return true;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+void WorkerPool::workerLoop(int self, std::chrono::nanoseconds period)
+{
+	// Same floating point mode as the audio thread, so the tasks give the same results on every thread
+	// and tails don't go denormal
+	VSTMath::ScopedFlushDenormals flushDenormals;
+	ScopedRealtimePriority realtimePriority(period);
+	// The calling thread is left to the host, worker self gets core self
+	ThreadAffinity affinity;
+	affinity.update(self, activePools.load() == 1);
+
+	uint32_t seen = generation.load(std::memory_order_acquire);
+	auto lastWork = Clock::now();
+	while (running.load(std::memory_order_relaxed))
+	{
+		const uint32_t current = generation.load(std::memory_order_acquire);
+		if (current != seen)
+		{
+			seen = current;
+			work(self, current);
+			lastWork = Clock::now();
+		}
+		else if (Clock::now() - lastWork < spinTime)
+		{
+			for (int i = 0; i < 64; ++i)
+				cpuRelax();
+		}
+		else
+		{
+			// Instances may have come or gone while this one was busy
+			affinity.update(self, activePools.load() == 1);
+			parked.fetch_add(1);
+			if (running.load() && generation.load() == seen)
+				parking->wait();
+			else if (!unpark())
+				parking->wait(); // counted by run() or stop() already, which post for this worker
+		}
+	}
+}
+
+}
+}
+} // namespaces
@@ -0,0 +1,144 @@
+#pragma once
+
+
+/*
+ * Worker threads that help the audio thread with work which splits into independent tasks
+ *
+ * run() hands out the tasks 0..numTasks-1 to the calling thread and the workers and returns once all of
+ * them are done. The tasks are split into one contiguous slice per thread. Every thread works through its
+ * own slice first and then steals from the slices of the others. Claiming a task is a compare-and-swap on
+ * its slice, so run() neither locks nor allocates.
+ *
+ * Every run() comes with a deadline, see ParallelFor. Workers only start tasks before it, the calling
+ * thread does everything else itself, so a worker that is asleep or wakes up late only costs parallelism.
+ * The calling thread waits for the tasks that a worker has already started, their output is never
+ * dropped. Once the deadline has passed, run() doesn't hand out anything to the workers anymore.
+ *
+ * The plugin instances of a process share one pool with a worker for every core but one, see
+ * acquireShared(). Several audio threads may call run() at the same time: one of them gets the workers,
+ * the others run their tasks on their own meanwhile.
+ *
+ * The workers run with real-time priority where the system allows it. Idle workers spin on the generation
+ * for a short while after each run() and then park on a semaphore. run() wakes the spinning ones with an
+ * atomic store and only posts the semaphore while workers are parked, it never takes a lock. The workers
+ * are pinned to cores of their own only while this is the single pool with workers in the process,
+ * several plugin instances would otherwise all fight for the same cores.
+ */
+
+
+#ifndef __WORKER_POOL_H__
+#define __WORKER_POOL_H__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+
+namespace Steinberg {
+namespace Vst {
+namespace NoteExpressionSynth {
+
+
+class WorkerPool
+{
+public:
+	// Called with the context passed to run() and the index of the task
+	using Task = void (*)(void* context, int task);
+
+	static constexpr int maxWorkers = 15;
+	static constexpr int maxTasks = 0xffff;
+
+	using Clock = std::chrono::steady_clock;
+
+	WorkerPool();
+	~WorkerPool();
+
+	// Start numWorkers threads (at most one less than there are cores). period is the time between two
+	// blocks of the host, the scheduler of macOS wants to know it for real-time threads. Not to be called
+	// from the audio thread.
+	void start(int numWorkers, std::chrono::nanoseconds period);
+	void stop();
+	int getNumWorkers() const { return static_cast<int>(workers.size()); }
+
+	// The pool shared by the whole process. The first acquireShared() starts its workers with the period of
+	// that caller, the last releaseShared() stops them. Not to be called from the audio thread.
+	static WorkerPool* acquireShared(std::chrono::nanoseconds period);
+	static void releaseShared();
+
+	// Run task(context, i) for all i in [0, numTasks) and return once all of them are done. numTasks must
+	// not exceed maxTasks. Without workers, once deadline has passed or while another thread is in run(),
+	// the tasks simply run in order on the calling thread.
+	void run(int numTasks, Task task, void* context, Clock::time_point deadline);
+
+private:
+	static constexpr int maxThreads = maxWorkers + 1;
+
+	// Generation (32 bits), end (16 bits) and next task (16 bits) of a slice packed into one word, so that
+	// a thread which is still busy with an old run() can't claim anything from the current one
+	struct alignas(64) Slice
+	{
+		std::atomic<uint64_t> state{ 0 };
+	};
+
+	// Counting semaphore of the system, defined in worker_pool.cpp
+	class Semaphore;
+
+	void workerLoop(int self, std::chrono::nanoseconds period);
+	// Claim and run tasks of a generation until none is left, starting with the slice of thread self
+	void work(int self, uint32_t generation);
+	bool claim(Slice& slice, uint32_t generation, int& index);
+	bool pastDeadline() const;
+	void wakeParked();
+	// Take back the count of a worker that didn't park after all. False if it has been taken already.
+	bool unpark();
+
+	std::array<Slice, maxThreads> slices;
+	// Set by the thread whose tasks the workers are running
+	alignas(64) std::atomic<bool> inUse{ false };
+	alignas(64) std::atomic<uint32_t> generation{ 0 };
+	alignas(64) std::atomic<int> remaining{ 0 };
+	// Workers read it before they claim a task, also while run() already sets up the next generation
+	std::atomic<Clock::rep> deadlineTicks{ 0 };
+	// Only read after a task of the current generation has been claimed, run() doesn't change them before
+	// that task is done
+	Task task = nullptr;
+	void* context = nullptr;
+
+	int numThreads = 1; // including the thread calling run()
+	std::vector<std::thread> workers;
+	std::atomic<bool> running{ false };
+	// Number of workers that are parked on the semaphore or about to be. Whoever takes the count (run() or
+	// stop()) posts the semaphore once for each of them.
+	std::unique_ptr<Semaphore> parking;
+	std::atomic<int> parked{ 0 };
+};
+
+
+// The workers of a plugin instance and the deadline of its current process() call. The Processor sets the
+// deadline once per call, so all the run()s of a call share one time budget: the length of the block.
+// Without workers the tasks run on the calling thread.
+struct ParallelFor
+{
+	WorkerPool* workers = nullptr;
+	WorkerPool::Clock::time_point deadline;
+
+	void operator()(int numTasks, WorkerPool::Task task, void* context) const
+	{
+		if (workers)
+		{
+			workers->run(numTasks, task, context, deadline);
+			return;
+		}
+		for (int i = 0; i < numTasks; ++i)
+			task(context, i);
+	}
+};
+
+}
+}
+} // namespaces
+#endif